@@ -0,0 +1,106 @@
+#ifndef GPTEST_ARENA_HPP_
+#define GPTEST_ARENA_HPP_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator, individual deallocations are no-ops,
+// all memory is released at once by reset().
+// Blocks are kept for reuse after reset.
+class Arena {
+public:
+    explicit Arena(std::size_t block_size = 1 << 20)
+        : block_size_(block_size),
+          current_(0),
+          offset_(0),
+          used_(0) {}
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena();
+
+    void* allocate(std::size_t size, std::size_t align);
+
+    // NOTE: all objects allocated in arena have to be destroyed
+    void reset();
+
+    // bytes allocated since last reset
+    std::size_t used() const {
+        return used_;
+    }
+
+    // total size of blocks
+    std::size_t capacity() const;
+
+private:
+    struct Block {
+        char* data;
+        std::size_t size;
+    };
+
+    std::size_t block_size_;
+    std::vector<Block> blocks_;
+    std::size_t current_;
+    std::size_t offset_;
+    std::size_t used_;
+};
+
+// Allocates from arena if set, from heap otherwise.
+// Copy-constructed containers allocate from heap,
+// use allocator-extended constructors to copy into arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator()
+        : arena_(nullptr) {}
+
+    explicit ArenaAllocator(Arena* arena)
+        : arena_(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : arena_(other.arena()) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(
+            arena_
+            ? arena_->allocate(n * sizeof(T), alignof(T))
+            : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) {
+        if (!arena_)
+            ::operator delete(p);
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const {
+        return ArenaAllocator();
+    }
+
+    Arena* arena() const {
+        return arena_;
+    }
+
+private:
+    Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return !(a == b);
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef GPTEST_CACHE_HPP_
+#define GPTEST_CACHE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "expr.hpp"
+#include "lru.hpp"
+#include "tree.hpp"
+
+// Values of subtrees over all fitness cases, keyed by structural hash.
+// Subtree expressions are stored to verify matches.
+// Least recently used entries are evicted when memory used by entries
+// exceeds capacity.
+class SubtreeCache {
+public:
+    static const std::size_t DefaultCapacity = 64 << 20;
+    static const std::size_t DefaultMinSubtreeSize = 3;
+
+    explicit SubtreeCache(std::size_t capacity = DefaultCapacity)
+        : cache_(capacity),
+          min_subtree_size_(DefaultMinSubtreeSize) {}
+
+    // cached values of subtree of `tree' at `pos' with given hash,
+    // nullptr if not found
+    const double* find(
+        const Tree& tree,
+        std::size_t pos,
+        std::uint64_t hash,
+        std::size_t case_num);
+
+    void insert(
+        const Tree& tree,
+        std::size_t pos,
+        std::uint64_t hash,
+        const double* values,
+        std::size_t case_num);
+
+    // remove all entries, e.g. when fitness cases change
+    void clear() {
+        cache_.clear();
+    }
+
+    void reset_stats() {
+        cache_.reset_stats();
+    }
+
+    // memory limit in bytes
+    void set_capacity(std::size_t capacity) {
+        cache_.set_capacity(capacity);
+    }
+
+    std::size_t capacity() const {
+        return cache_.capacity();
+    }
+
+    // smaller subtrees are not cached
+    void set_min_subtree_size(std::size_t min_subtree_size) {
+        min_subtree_size_ = min_subtree_size;
+    }
+
+    std::size_t min_subtree_size() const {
+        return min_subtree_size_;
+    }
+
+    std::size_t size() const {
+        return cache_.size();
+    }
+
+    std::size_t memory() const {
+        return cache_.memory();
+    }
+
+    std::size_t hits() const {
+        return cache_.hits();
+    }
+
+    std::size_t misses() const {
+        return cache_.misses();
+    }
+
+    std::size_t evictions() const {
+        return cache_.evictions();
+    }
+
+private:
+    struct Entry {
+        std::vector<const Expr*> exprs; // subtree in prefix order
+        std::vector<double> values;
+
+        std::size_t memory() const;
+    };
+
+    static bool matches(
+        const Entry& entry,
+        const Tree& tree,
+        std::size_t pos,
+        std::size_t case_num);
+
+    LruCache<std::uint64_t, Entry> cache_;
+    std::size_t min_subtree_size_;
+};
+
+// Fitness and deviations of whole trees over all fitness cases,
+// keyed by structural hash (see tree_hash).
+// Tree expressions are stored to verify matches.
+// Least recently used entries are evicted when memory used by entries
+// exceeds capacity.
+class FitnessCache {
+public:
+    static const std::size_t DefaultCapacity = 64 << 20;
+
+    explicit FitnessCache(std::size_t capacity = DefaultCapacity)
+        : cache_(capacity) {}
+
+    // if `tree' with given hash is found, sets `fitness', copies
+    // deviations to `errors' and returns true
+    bool find(
+        const Tree& tree,
+        std::uint64_t hash,
+        std::size_t case_num,
+        double& fitness,
+        double* errors);
+
+    void insert(
+        const Tree& tree,
+        std::uint64_t hash,
+        std::size_t case_num,
+        double fitness,
+        const double* errors);
+
+    // remove all entries, e.g. when fitness cases change
+    void clear() {
+        cache_.clear();
+    }
+
+    void reset_stats() {
+        cache_.reset_stats();
+    }
+
+    // memory limit in bytes
+    void set_capacity(std::size_t capacity) {
+        cache_.set_capacity(capacity);
+    }
+
+    std::size_t capacity() const {
+        return cache_.capacity();
+    }
+
+    std::size_t size() const {
+        return cache_.size();
+    }
+
+    std::size_t memory() const {
+        return cache_.memory();
+    }
+
+    std::size_t hits() const {
+        return cache_.hits();
+    }
+
+    std::size_t misses() const {
+        return cache_.misses();
+    }
+
+    std::size_t evictions() const {
+        return cache_.evictions();
+    }
+
+private:
+    struct Entry {
+        std::vector<const Expr*> exprs; // tree in prefix order
+        double fitness;
+        std::vector<double> errors;
+
+        std::size_t memory() const;
+    };
+
+    LruCache<std::uint64_t, Entry> cache_;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef GPTEST_CHECKPOINT_HPP_
+#define GPTEST_CHECKPOINT_HPP_
+
+#include <exception>
+#include <string>
+#include <thread>
+#include "run.hpp"
+
+// Write `data' to a temporary file next to `path' and rename it,
+// file at `path' is either the old or the complete new one.
+// Throws std::runtime_error on failure
+void write_file_atomic(const std::string& path, const std::string& data);
+
+// throws std::runtime_error on failure
+std::string read_file(const std::string& path);
+
+// Writes checkpoints of a run (see Run::checkpoint) every
+// `interval' generations. Snapshot is taken on calling thread,
+// file is written on a background thread while the run continues.
+class Checkpointer {
+public:
+    Checkpointer(Run& run, const std::string& path, unsigned interval);
+
+    // waits for pending write, its error is ignored
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // call after each generation, saves checkpoint if generation
+    // is a multiple of interval
+    void update();
+
+    // save checkpoint of current state, waits for previous write,
+    // throws its error
+    void save();
+
+    // wait for pending write, throws std::runtime_error if it failed
+    void wait();
+
+    const std::string& path() const {
+        return path_;
+    }
+
+private:
+    Run& run_;
+    std::string path_;
+    unsigned interval_;
+    std::thread thread_;
+    std::exception_ptr error_;
+};
+
+#endif
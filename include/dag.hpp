@@ -0,0 +1,88 @@
+#ifndef GPTEST_DAG_HPP_
+#define GPTEST_DAG_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "dataset.hpp"
+#include "expr.hpp"
+#include "tree.hpp"
+
+// Structural hash of each subtree of `tree', indexed by node position
+void subtree_hashes(const Tree& tree, std::vector<std::uint64_t>& hashes);
+
+// Structural hash of a tree
+std::uint64_t tree_hash(const Tree& tree);
+
+// Hash-consed store of subtrees: structurally identical subtrees
+// (same expression and same children) are stored once and get the
+// same id, so subtrees can be compared by id.
+// Children are always interned before their parents, so unique
+// subtrees can be evaluated in id order.
+class Dag {
+public:
+    typedef std::uint32_t Id;
+
+    static const Id NoId = std::numeric_limits<Id>::max();
+
+    struct Node {
+        const Expr* expr; // nullptr for missing child
+        std::uint64_t hash;
+        std::uint32_t children; // position of first child id
+        std::uint16_t arity;
+    };
+
+    Dag()
+        : table_(16, NoId) {}
+
+    // intern all subtrees of `tree', returns id of root;
+    // ids of subtrees are stored in `ids' by node position if provided
+    Id intern(const Tree& tree, std::vector<Id>* ids = nullptr);
+
+    void clear();
+
+    // number of unique subtrees
+    std::size_t size() const {
+        return nodes_.size();
+    }
+
+    const Node& node(Id id) const {
+        return nodes_[id];
+    }
+
+    // terminals have no children, pointer may be past the end
+    const Id* children(Id id) const {
+        return children_.data() + nodes_[id].children;
+    }
+
+    std::uint64_t hash(Id id) const {
+        return nodes_[id].hash;
+    }
+
+    // Calculate values of all unique subtrees for cases
+    // [begin, begin + len) of `dataset' column-wise, `columns' is set
+    // to values of each subtree by id: dataset columns for terminals,
+    // `len' values in `buffer' for functions
+    void eval(
+        const Dataset& dataset,
+        std::size_t begin,
+        std::size_t len,
+        std::vector<double>& buffer,
+        std::vector<const double*>& columns) const;
+
+private:
+    Id find_or_add(
+        const Expr* expr,
+        std::uint64_t hash,
+        const Id* children,
+        unsigned arity);
+
+    void grow_table();
+
+    std::vector<Node> nodes_;
+    std::vector<Id> children_;
+    std::vector<Id> table_; // open addressing, linear probing
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef GPTEST_DATASET_HPP_
+#define GPTEST_DATASET_HPP_
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "expr.hpp"
+
+typedef std::pair<Params, double> FitnessCase;
+typedef std::vector<FitnessCase> FitnessCaseList;
+
+// Fitness cases stored by column: one contiguous column
+// per terminal followed by target column.
+// Values are either owned or mapped from a dataset file.
+//
+// Dataset file: 64-byte header (see dataset.cpp) followed by columns
+// in the same layout, values are doubles in native byte order.
+class Dataset {
+public:
+    Dataset()
+        : case_num_(0),
+          column_num_(0) {}
+
+    explicit Dataset(const FitnessCaseList& fitness_cases) {
+        assign(fitness_cases);
+    }
+
+    void assign(const FitnessCaseList& fitness_cases);
+
+    // copy cases of `dataset' at positions `rows'
+    void assign(const Dataset& dataset, const std::vector<std::size_t>& rows);
+
+    // map dataset file read-only, mapping is shared by copies,
+    // throws std::runtime_error on failure
+    void map(const std::string& path);
+
+    // write dataset file
+    void write(const std::string& path) const;
+
+    bool mapped() const {
+        return static_cast<bool>(mapping_);
+    }
+
+    std::size_t case_num() const {
+        return case_num_;
+    }
+
+    // number of terminal columns
+    std::size_t column_num() const {
+        return column_num_;
+    }
+
+    const double* column(std::size_t index) const {
+        assert(index < column_num_);
+        return values() + index * case_num_;
+    }
+
+    const double* target() const {
+        return values() + column_num_ * case_num_;
+    }
+
+    // parameters of `index'-th case
+    void params(std::size_t index, Params& params) const;
+
+private:
+    class Mapping;
+
+    const double* values() const;
+
+    std::size_t case_num_;
+    std::size_t column_num_;
+    std::vector<double> data_;
+    std::shared_ptr<const Mapping> mapping_;
+};
+
+// Writes dataset file case by case,
+// number of cases must be known in advance
+class DatasetWriter {
+public:
+    DatasetWriter(
+        const std::string& path,
+        std::size_t case_num,
+        std::size_t column_num);
+
+    DatasetWriter(const DatasetWriter&) = delete;
+
+    DatasetWriter& operator=(const DatasetWriter&) = delete;
+
+    // `params' has `column_num' values
+    void add(const double* params, double target);
+
+    // flush buffers, throws std::logic_error if number of
+    // added cases is not `case_num'
+    void close();
+
+private:
+    void flush();
+
+    std::ofstream file_;
+    std::size_t case_num_;
+    std::size_t column_num_;
+    std::size_t added_num_;
+    std::size_t flushed_num_;
+    std::vector<std::vector<double>> buffers_; // one per column
+};
+
+#endif
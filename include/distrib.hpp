@@ -0,0 +1,137 @@
+#ifndef GPTEST_DISTRIB_HPP_
+#define GPTEST_DISTRIB_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "dataset.hpp"
+#include "expr.hpp"
+#include "indiv.hpp"
+#include "run.hpp"
+#include "wire.hpp"
+
+// Islands in separate processes.
+// Workers run islands and connect to a coordinator, which collects
+// statistics and passes migrants to the next live worker (ring).
+// Address: "host:port" for TCP, "unix:path" for Unix domain socket.
+// Messages are length-prefixed, individuals are encoded with
+// IndivCodec, so all processes must use the same terminal and
+// function lists.
+
+// Write `dataset' to shared memory (/dev/shm) or temporary directory,
+// workers can map it with Run::load_dataset, returns path.
+// File is removed by caller.
+std::string share_dataset(const Dataset& dataset, const std::string& name);
+
+class Connection;
+
+class Coordinator {
+public:
+    struct GenerationStats {
+        unsigned generation;
+        std::size_t worker_num; // workers reported
+        std::size_t population_size; // total of reported islands
+        double best;
+        double avg;
+        double worst;
+    };
+
+    // start listening, port 0 for any free port,
+    // lists are used to decode harvest and must outlive it
+    Coordinator(
+        const std::string& address,
+        const TermList& term_list,
+        const FuncList& func_list);
+
+    Coordinator(const Coordinator&) = delete;
+
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    ~Coordinator();
+
+    // listening address, with actual port for TCP
+    const std::string& address() const {
+        return address_;
+    }
+
+    // accept up to `worker_num' workers for `accept_timeout' ms,
+    // serve them until all are done or disconnected
+    void run(std::size_t worker_num, int accept_timeout = 10000);
+
+    // statistics by generation
+    const std::vector<GenerationStats>& stats() const {
+        return stats_;
+    }
+
+    bool solution_found() const {
+        return solution_found_;
+    }
+
+    // fit individuals reported by workers
+    const Population& harvest() const {
+        return harvest_;
+    }
+
+    // number of workers disconnected before finishing
+    std::size_t lost_worker_num() const {
+        return lost_worker_num_;
+    }
+
+private:
+    struct Peer;
+
+    // returns false if peer is disconnected
+    bool handle(Peer& peer, std::uint8_t type, const std::string& data);
+
+    void close_peer(Peer& peer, bool lost);
+
+    std::string address_;
+    std::string unix_path_; // removed on destruction
+    int listen_fd_;
+    IndivCodec codec_;
+    std::vector<std::unique_ptr<Peer>> peers_;
+    std::vector<GenerationStats> stats_;
+    bool solution_found_;
+    Population harvest_;
+    std::size_t lost_worker_num_;
+};
+
+class Worker {
+public:
+    // connect to coordinator, `run' is set up with initial population
+    Worker(const std::string& address, Run& run);
+
+    Worker(const Worker&) = delete;
+
+    Worker& operator=(const Worker&) = delete;
+
+    ~Worker();
+
+    // send migrants every `interval' generations
+    void set_migration_interval(unsigned interval) {
+        migration_interval_ = interval;
+    }
+
+    void set_migrant_num(std::size_t migrant_num) {
+        migrant_num_ = migrant_num;
+    }
+
+    // run until finished or stopped by coordinator,
+    // harvest is sent to coordinator
+    void run();
+
+private:
+    // handle incoming messages without waiting
+    void receive();
+
+    Run& run_;
+    IndivCodec codec_;
+    std::unique_ptr<Connection> connection_;
+    unsigned migration_interval_;
+    std::size_t migrant_num_;
+    bool stopped_;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef GPTEST_EVAL_HPP_
+#define GPTEST_EVAL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "cache.hpp"
+#include "dataset.hpp"
+#include "expr.hpp"
+#include "tree.hpp"
+
+// Column-wise tree evaluator: each node is evaluated once for a block
+// of fitness cases, terminal values are read directly from dataset
+// columns. Functions without batch version are called for each case.
+// If subtree cache is set, subtrees are evaluated over all cases at
+// once and cached values are used instead of evaluating subtrees.
+class BatchEval {
+public:
+    static const std::size_t DefaultBlockSize = 256;
+
+    explicit BatchEval(std::size_t block_size = DefaultBlockSize)
+        : block_size_(block_size),
+          cache_(nullptr) {}
+
+    // write values of `tree' for all cases of `dataset' to `out'
+    void eval(const Tree& tree, const Dataset& dataset, double* out);
+
+    // write values for cases [begin, end) to `out', cache is not used
+    void eval(
+        const Tree& tree,
+        const Dataset& dataset,
+        std::size_t begin,
+        std::size_t end,
+        double* out);
+
+    // nullptr to disable caching
+    void set_cache(SubtreeCache* cache) {
+        cache_ = cache;
+    }
+
+    SubtreeCache* cache() const {
+        return cache_;
+    }
+
+private:
+    struct Column {
+        const double* values;
+        int buffer; // buffer index or NoBuffer for dataset columns
+    };
+
+    static const int NoBuffer = -1;
+
+    void eval_block(
+        const Tree& tree,
+        const Dataset& dataset,
+        std::size_t begin,
+        std::size_t len,
+        double* out);
+
+    // evaluate subtree at `pos' using cache,
+    // value of root is written to `out' if set
+    Column eval_subtree(
+        const Tree& tree,
+        const Dataset& dataset,
+        std::size_t pos,
+        double* out);
+
+    // apply function to `args_'
+    void apply(
+        const Func* func,
+        unsigned arity,
+        double* result,
+        std::size_t len);
+
+    // buffer of at least `len' values
+    int acquire_buffer(std::size_t len);
+
+    std::size_t block_size_;
+    SubtreeCache* cache_;
+    std::vector<std::uint64_t> hashes_; // subtree hashes for cache
+    std::vector<std::vector<double>> buffers_;
+    std::vector<int> free_buffers_;
+    std::vector<Column> stack_;
+    std::vector<const double*> args_;
+    Params params_;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include <cassert>
+#include <cstddef>
 #include <functional>
 #include <iterator>
 #include <memory>
@@ -11,9 +12,36 @@
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "rng.hpp"
 
 typedef std::vector<double> Params;
 
+// Function applied to `n' argument tuples at once,
+// args[i] points to column of i-th arguments
+typedef void (*BatchFunction)(
+    double* out,
+    const double* const* args,
+    std::size_t n);
+
+// Function of fixed arity reading arguments from evaluation stack,
+// `top' points past the last argument, first argument is on top
+// of the stack (top[-1]), see primitives.hpp
+typedef double (*StackFunction)(const double* top);
+
+// Built-in functions evaluators can inline, see func.hpp
+enum Builtin {
+    BuiltinNone,
+    BuiltinPlus2,
+    BuiltinMinus2,
+    BuiltinMult2,
+    BuiltinMult3,
+    BuiltinSafeDiv2,
+    BuiltinSin1,
+    BuiltinCos1,
+    BuiltinRlog1,
+    BuiltinExp1
+};
+
 class Expr;
 class Term;
 class Func;
@@ -22,16 +50,20 @@ typedef std::vector<std::shared_ptr<Term>> TermList;
 typedef std::vector<std::shared_ptr<Func>> FuncList;
 
 template <typename C>
-const typename C::value_type& random_element(const C& c) {
+const typename C::value_type& random_element(const C& c, Rng& rng) {
     auto it = c.cbegin();
     if (it == c.cend())
         throw std::logic_error("Container is empty");
-    std::random_device rd;
     std::uniform_int_distribution<int> distr(0, std::distance(it, c.cend()) - 1);
-    std::advance(it, distr(rd));
+    std::advance(it, distr(rng));
     return *it;
 }
 
+template <typename C>
+const typename C::value_type& random_element(const C& c) {
+    return random_element(c, default_rng());
+}
+
 class Expr {
 public:
     Expr(const std::string& name)
@@ -47,7 +79,12 @@ public:
 
     virtual double eval(const Params&) const = 0;
 
-    virtual std::string get_name() {
+    virtual std::string get_name() const {
+        return name_;
+    }
+
+    // name without copying, for writing trees
+    const std::string& name() const {
         return name_;
     }
 
@@ -78,6 +115,10 @@ public:
         return params[id_];
     }
 
+    int id() const {
+        return id_;
+    }
+
 private:
     int id_;
     std::string name_;
@@ -88,9 +129,15 @@ public:
     Func(
         std::function<double(const Params&)> func,
         unsigned arity,
-        std::string name)
+        std::string name,
+        BatchFunction batch_func = nullptr,
+        Builtin builtin = BuiltinNone,
+        StackFunction stack_func = nullptr)
         : Expr(name),
           func_(func),
+          batch_func_(batch_func),
+          stack_func_(stack_func),
+          builtin_(builtin),
           arity_(arity) {}
 
     virtual unsigned arity() const {
@@ -109,8 +156,33 @@ public:
         return func_(args);
     }
 
+    // nullptr if function has no batch version
+    BatchFunction batch_func() const {
+        return batch_func_;
+    }
+
+    // apply to `n' argument tuples using batch version if any,
+    // `params' is used for calling scalar version
+    void eval_batch(
+        double* out,
+        const double* const* args,
+        std::size_t n,
+        Params& params) const;
+
+    Builtin builtin() const {
+        return builtin_;
+    }
+
+    // nullptr if function has no stack version
+    StackFunction stack_func() const {
+        return stack_func_;
+    }
+
 private:
     std::function<double(const Params&)> func_;
+    BatchFunction batch_func_;
+    StackFunction stack_func_;
+    Builtin builtin_;
     int arity_;
 };
 
@@ -21,4 +21,31 @@ double rlog1(const Params& args);
 
 double exp1(const Params& args);
 
+// Batch versions
+
+void plus2_batch(double* out, const double* const* args, std::size_t n);
+
+void minus2_batch(double* out, const double* const* args, std::size_t n);
+
+void mult2_batch(double* out, const double* const* args, std::size_t n);
+
+void mult3_batch(double* out, const double* const* args, std::size_t n);
+
+void safe_div2_batch(double* out, const double* const* args, std::size_t n);
+
+void sin1_batch(double* out, const double* const* args, std::size_t n);
+
+void cos1_batch(double* out, const double* const* args, std::size_t n);
+
+void rlog1_batch(double* out, const double* const* args, std::size_t n);
+
+void exp1_batch(double* out, const double* const* args, std::size_t n);
+
+// Batch version of a function defined above, nullptr for other functions
+BatchFunction find_batch_function(
+    const std::function<double(const Params&)>& func);
+
+// Built-in ID of a function defined above, BuiltinNone for other functions
+Builtin find_builtin(const std::function<double(const Params&)>& func);
+
 #endif
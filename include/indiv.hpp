@@ -3,37 +3,63 @@
 
 #include <cstddef>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
+#include "dataset.hpp"
+#include "eval.hpp"
 #include "expr.hpp"
+#include "program.hpp"
+#include "simplify.hpp"
 #include "tree.hpp"
 
-typedef std::pair<Params, double> FitnessCase;
-typedef std::vector<FitnessCase> FitnessCaseList;
-typedef std::function<double(std::vector<double>)> FitnessCombine;
+// Fitness from deviations of `n' cases
+typedef std::function<double(const double* diff, std::size_t n)> FitnessCombine;
 
-double fitness_combine_sum_abs(std::vector<double> diff);
+double fitness_combine_sum_abs(const double* diff, std::size_t n);
 
-double fitness_combine_sum_squared(std::vector<double> diff);
+double fitness_combine_sum_squared(const double* diff, std::size_t n);
+
+// error term of a single deviation for fitness combine methods
+// that sum terms over all cases, allows partial evaluation
+typedef double (*FitnessTerm)(double diff);
+
+// term of built-in combine method, nullptr for other methods
+FitnessTerm find_fitness_term(const FitnessCombine& combine);
 
 class Indiv {
 public:
     explicit Indiv(const Tree& tree)
         : tree_(tree),
-          has_fitness_(false) {}
+          has_fitness_(false),
+          fitness_bounded_(false) {}
 
     explicit Indiv(Tree&& tree)
         : tree_(std::move(tree)),
-          has_fitness_(false) {}
+          has_fitness_(false),
+          fitness_bounded_(false) {}
 
     Indiv(const Indiv& other)
         : tree_(other.tree_),
+          program_(other.program_),
+          has_fitness_(other.has_fitness_),
+          fitness_bounded_(other.fitness_bounded_),
+          fitness_(other.fitness_) {}
+
+    // copy tree using given allocator
+    Indiv(const Indiv& other, const Tree::Allocator& alloc)
+        : tree_(other.tree_, alloc),
+          program_(other.program_),
           has_fitness_(other.has_fitness_),
+          fitness_bounded_(other.fitness_bounded_),
           fitness_(other.fitness_) {}
 
-    Indiv(Indiv&& other)
+    Indiv(Indiv&& other) noexcept
         : tree_(std::move(other.tree_)),
+          program_(std::move(other.program_)),
           has_fitness_(other.has_fitness_),
+          fitness_bounded_(other.fitness_bounded_),
           fitness_(other.fitness_) {}
 
     Indiv& operator=(const Indiv& other);
@@ -46,6 +72,41 @@ public:
 
     void eval(const FitnessCaseList& fitness_cases);
 
+    // Deviations from targets are written to `errors'
+    // (`dataset.case_num()' values).
+    // Evaluation over dataset stops early once partial error of
+    // a summing combine method (see find_fitness_term) exceeds `bound',
+    // fitness is then a lower bound of the actual value
+    // (see fitness_bounded()) and only first errors are written.
+
+    // evaluate over all cases at once
+    void eval(
+        const Dataset& dataset,
+        BatchEval& evaluator,
+        const FitnessCombine& combine,
+        double* errors,
+        double bound = std::numeric_limits<double>::infinity());
+
+    // evaluate using compiled program,
+    // program is compiled to native code if `native' is true
+    void eval(
+        const Dataset& dataset,
+        const FitnessCombine& combine,
+        double* errors,
+        bool native = false,
+        double bound = std::numeric_limits<double>::infinity());
+
+    void set_fitness(double fitness, bool bounded = false) {
+        fitness_ = fitness;
+        has_fitness_ = true;
+        fitness_bounded_ = bounded;
+    }
+
+    void reset_fitness() {
+        has_fitness_ = false;
+        fitness_bounded_ = false;
+    }
+
     bool has_fitness() const {
         return has_fitness_;
     }
@@ -56,13 +117,33 @@ public:
         return fitness_;
     }
 
+    // true if evaluation was cut short,
+    // fitness is a lower bound
+    bool fitness_bounded() const {
+        return fitness_bounded_;
+    }
+
     const Tree& tree() const {
         return tree_;
     }
 
+    // compiled tree, compiled on first use,
+    // shared with copies of the individual
+    const Program& program(bool native = false);
+
+    // compile simplified tree (see Simplified), used by
+    // program-based evaluation, tree is kept
+    void simplify_program();
+
+    // replace tree with simplified tree allocated on heap,
+    // fitness is kept
+    void simplify_tree();
+
 private:
     Tree tree_;
+    std::shared_ptr<const Program> program_;
     bool has_fitness_;
+    bool fitness_bounded_;
     double fitness_;
 };
 
@@ -71,14 +152,80 @@ Indiv crossover(
     const Indiv& p2,
     float p_term = 0.1);
 
+// offspring tree is allocated using `alloc'
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    float p_term = 0.1);
+
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    Rng& rng,
+    float p_term = 0.1);
+
+// Limits of offspring trees, 0 for no limit
+struct TreeLimits {
+    explicit TreeLimits(unsigned max_depth = 0, std::size_t max_size = 0)
+        : max_depth(max_depth),
+          max_size(max_size) {}
+
+    bool empty() const {
+        return max_depth == 0 && max_size == 0;
+    }
+
+    unsigned max_depth; // see Tree::depth
+    std::size_t max_size; // number of nodes
+};
+
+// Crossover points are chosen again a few times if offspring
+// would exceed `limits', individual with empty tree is returned
+// if no offspring fits (parent can be copied instead)
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    Rng& rng,
+    const TreeLimits& limits,
+    float p_term = 0.1);
+
 typedef std::vector<Indiv> Population;
 
 Population make_pop_ramped_hnh(
     const TermList& term_list,
     const FuncList& func_list,
     unsigned depth,
-    std::size_t n);
+    std::size_t n,
+    Rng& rng = default_rng());
+
+// Parsimony pressure in selection
+enum ParsimonyMode {
+    ParsimonyNone,
+    ParsimonyLexicographic, // smaller tree wins if fitness is equal
+    ParsimonyCoefficient    // fitness + coefficient * tree size is compared
+};
+
+// true if `a' is more fit than `b', lower bounds are compared
+// as values, exact fitness wins over equal bound, NaN is least fit
+bool fitter(const Indiv& a, const Indiv& b);
+
+// same with parsimony pressure
+bool fitter(
+    const Indiv& a,
+    const Indiv& b,
+    ParsimonyMode parsimony,
+    double coefficient = 0.0);
+
+const Indiv& tournament(const Population& pop, Rng& rng);
 
 const Indiv& tournament(const Population& pop);
 
+const Indiv& tournament(
+    const Population& pop,
+    Rng& rng,
+    ParsimonyMode parsimony,
+    double coefficient = 0.0);
+
 #endif
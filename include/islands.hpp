@@ -0,0 +1,100 @@
+#ifndef GPTEST_ISLANDS_HPP_
+#define GPTEST_ISLANDS_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "indiv.hpp"
+#include "run.hpp"
+
+// Island model: independent runs (islands) advancing on their own
+// threads, fittest individuals migrate to other islands periodically.
+// Migrants are passed through single-slot mailboxes with atomic
+// exchange, so islands never wait for each other; migrants not
+// collected before the next delivery are replaced.
+// Islands must have the same terminals and functions in the same
+// order, trees of migrants are rebuilt with expressions of the
+// receiving island.
+class Islands {
+public:
+    enum Topology {
+        TopologyRing,  // island i sends to island i + 1
+        TopologyRandom // random other island each time
+    };
+
+    typedef std::function<void(Run& run, std::size_t index)> Setup;
+
+    // `setup' configures each island: generation number,
+    // terminals, functions, fitness cases and initial population;
+    // throws std::invalid_argument if primitive sets differ
+    Islands(std::size_t island_num, const Setup& setup);
+
+    Islands(const Islands&) = delete;
+
+    Islands& operator=(const Islands&) = delete;
+
+    ~Islands();
+
+    std::size_t island_num() const {
+        return islands_.size();
+    }
+
+    Run& island(std::size_t index) {
+        return *islands_.at(index);
+    }
+
+    void set_topology(Topology topology) {
+        topology_ = topology;
+    }
+
+    // migrate every `interval' generations
+    void set_migration_interval(unsigned interval) {
+        migration_interval_ = interval;
+    }
+
+    // number of individuals sent by an island at once
+    void set_migrant_num(std::size_t migrant_num) {
+        migrant_num_ = migrant_num;
+    }
+
+    // island seeds are derived from `seed'
+    void set_seed(std::uint64_t seed);
+
+    // advance islands until each is finished or one of them
+    // found a solution, exceptions are rethrown after all
+    // islands stop
+    void run();
+
+    bool solution_found();
+
+    Population harvest();
+
+    double avg_fitness();
+
+    std::pair<double, double> best_worst_fitness();
+
+private:
+    void run_island(std::size_t index);
+
+    // copies of `migrants' with expressions of island `index'
+    Population localize(const Population& migrants, std::size_t index) const;
+
+    std::vector<std::unique_ptr<Run>> islands_;
+    std::vector<std::atomic<Population*>> mailboxes_; // one per island
+    // position in terminal and function lists of expressions
+    // of all islands, expressions of each island by position
+    std::unordered_map<const Expr*, std::size_t> expr_positions_;
+    std::vector<std::vector<const Expr*>> island_exprs_;
+    Topology topology_;
+    unsigned migration_interval_;
+    std::size_t migrant_num_;
+    std::uint64_t seed_;
+    std::atomic<bool> solved_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef GPTEST_JIT_HPP_
+#define GPTEST_JIT_HPP_
+
+#include <cstddef>
+#include "dataset.hpp"
+
+class Program;
+
+// Native x86-64 machine code compiled from a program.
+// Built-in arithmetic is inlined, other functions are called.
+class NativeCode {
+public:
+    // true if native code can be generated on this platform
+    static bool supported();
+
+    // throws std::runtime_error if not supported
+    explicit NativeCode(const Program& program);
+
+    NativeCode(const NativeCode&) = delete;
+
+    NativeCode& operator=(const NativeCode&) = delete;
+
+    ~NativeCode();
+
+    // write values for cases [begin, end) of `dataset' to `out'
+    void eval(
+        const Dataset& dataset,
+        std::size_t begin,
+        std::size_t end,
+        double* out) const;
+
+    // size of generated code
+    std::size_t size() const {
+        return size_;
+    }
+
+private:
+    // columns, case number, output, value stack
+    typedef void (*Function)(
+        const double* const*,
+        std::size_t,
+        double*,
+        double*);
+
+    void* code_;
+    std::size_t size_;
+    std::size_t mapped_size_;
+    std::size_t stack_size_;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef GPTEST_LRU_HPP_
+#define GPTEST_LRU_HPP_
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Values by key, least recently used entries are evicted when memory
+// used by entries exceeds capacity. Value::memory() is the memory
+// used by a value in bytes.
+template <typename Key, typename Value>
+class LruCache {
+public:
+    explicit LruCache(std::size_t capacity)
+        : capacity_(capacity),
+          memory_(0),
+          hits_(0),
+          misses_(0),
+          evictions_(0) {}
+
+    // value of `key' if `match(value)' is true, value becomes
+    // most recently used; nullptr otherwise
+    template <typename Match>
+    const Value* find(const Key& key, Match match) {
+        auto it = map_.find(key);
+        if (it == map_.end() || !match(it->second->second)) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        // move to front
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return &it->second->second;
+    }
+
+    // replaces entry with the same key
+    void insert(const Key& key, Value&& value) {
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            memory_ -= it->second->second.memory();
+            entries_.erase(it->second);
+            map_.erase(it);
+        }
+        entries_.emplace_front(key, std::move(value));
+        map_[key] = entries_.begin();
+        memory_ += entries_.front().second.memory();
+        evict();
+    }
+
+    void clear() {
+        entries_.clear();
+        map_.clear();
+        memory_ = 0;
+    }
+
+    void reset_stats() {
+        hits_ = misses_ = evictions_ = 0;
+    }
+
+    // memory limit in bytes
+    void set_capacity(std::size_t capacity) {
+        capacity_ = capacity;
+        evict();
+    }
+
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+    std::size_t size() const {
+        return map_.size();
+    }
+
+    std::size_t memory() const {
+        return memory_;
+    }
+
+    std::size_t hits() const {
+        return hits_;
+    }
+
+    std::size_t misses() const {
+        return misses_;
+    }
+
+    std::size_t evictions() const {
+        return evictions_;
+    }
+
+private:
+    typedef std::list<std::pair<Key, Value>> EntryList;
+
+    void evict() {
+        while (memory_ > capacity_ && !entries_.empty()) {
+            memory_ -= entries_.back().second.memory();
+            map_.erase(entries_.back().first);
+            entries_.pop_back();
+            ++evictions_;
+        }
+    }
+
+    std::size_t capacity_;
+    std::size_t memory_;
+    std::size_t hits_;
+    std::size_t misses_;
+    std::size_t evictions_;
+    EntryList entries_; // most recently used first
+    std::unordered_map<Key, typename EntryList::iterator> map_;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef GPTEST_POOL_HPP_
+#define GPTEST_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed set of worker threads running chunked loops.
+// Each worker gets a contiguous part of the chunks, idle workers
+// steal chunks from the end of other workers' queues.
+// Calling thread works as worker 0.
+class ThreadPool {
+public:
+    // `begin', `end' - chunk range, `worker' - index of worker thread
+    typedef std::function<void(
+        std::size_t begin,
+        std::size_t end,
+        std::size_t worker)> Task;
+
+    // `thread_num' workers including calling thread,
+    // 0 for number of hardware threads
+    explicit ThreadPool(std::size_t thread_num = 0);
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    std::size_t thread_num() const {
+        return queues_.size();
+    }
+
+    // call `task' for chunks of [0, n) of `chunk_size' items
+    // and wait for completion, first exception thrown by
+    // the task is rethrown
+    void run(std::size_t n, std::size_t chunk_size, const Task& task);
+
+private:
+    typedef std::pair<std::size_t, std::size_t> Range;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Range> chunks;
+    };
+
+    void thread_main(std::size_t worker);
+
+    void work(std::size_t worker);
+
+    // take chunk from own queue or steal from another one
+    bool pop(std::size_t worker, Range& range);
+
+    std::vector<std::unique_ptr<Queue>> queues_; // one per worker
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const Task* task_;
+    std::size_t round_; // incremented for each run
+    std::size_t active_num_; // threads working on current run
+    bool stop_;
+    std::atomic<bool> failed_;
+    std::exception_ptr error_;
+};
+
+#endif
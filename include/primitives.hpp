@@ -0,0 +1,137 @@
+#ifndef GPTEST_PRIMITIVES_HPP_
+#define GPTEST_PRIMITIVES_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "expr.hpp"
+
+// Compile-time primitive sets.
+// Functions are declared with fixed arity, wrappers below generate
+// stack (see StackFunction), batch and generic versions calling
+// the function directly, so calls can be inlined and no argument
+// vectors are built:
+//
+//     double add(double a, double b) { return a + b; }
+//     double neg(double a) { return -a; }
+//
+//     PrimitiveSet<Prim2<add>, Prim1<neg>> prims({"+", "neg"});
+//     run.add_functions(prims.funcs());
+
+template <double (*F)(double)>
+struct Prim1 {
+    static const unsigned arity = 1;
+
+    static double call(const double* top) {
+        return F(top[-1]);
+    }
+
+    static void batch(double* out, const double* const* args, std::size_t n) {
+        const double* a0 = args[0];
+        for (std::size_t k = 0; k < n; ++k)
+            out[k] = F(a0[k]);
+    }
+
+    static double eval(const Params& args) {
+        assert(args.size() == arity);
+        return F(args[0]);
+    }
+};
+
+template <double (*F)(double, double)>
+struct Prim2 {
+    static const unsigned arity = 2;
+
+    static double call(const double* top) {
+        return F(top[-1], top[-2]);
+    }
+
+    static void batch(double* out, const double* const* args, std::size_t n) {
+        const double* a0 = args[0];
+        const double* a1 = args[1];
+        for (std::size_t k = 0; k < n; ++k)
+            out[k] = F(a0[k], a1[k]);
+    }
+
+    static double eval(const Params& args) {
+        assert(args.size() == arity);
+        return F(args[0], args[1]);
+    }
+};
+
+template <double (*F)(double, double, double)>
+struct Prim3 {
+    static const unsigned arity = 3;
+
+    static double call(const double* top) {
+        return F(top[-1], top[-2], top[-3]);
+    }
+
+    static void batch(double* out, const double* const* args, std::size_t n) {
+        const double* a0 = args[0];
+        const double* a1 = args[1];
+        const double* a2 = args[2];
+        for (std::size_t k = 0; k < n; ++k)
+            out[k] = F(a0[k], a1[k], a2[k]);
+    }
+
+    static double eval(const Params& args) {
+        assert(args.size() == arity);
+        return F(args[0], args[1], args[2]);
+    }
+};
+
+// Set of primitives wrapped in Prim1, Prim2 or Prim3
+template <typename... Prims>
+class PrimitiveSet {
+public:
+    static const std::size_t size = sizeof...(Prims);
+
+    // `names' are in order of primitives
+    explicit PrimitiveSet(const std::vector<std::string>& names) {
+        if (names.size() != size)
+            throw std::invalid_argument(
+                "Number of names does not match number of primitives");
+
+        static const BatchFunction batch_funcs[] = {&Prims::batch...};
+        static double (* const eval_funcs[])(const Params&) = {&Prims::eval...};
+        for (std::size_t i = 0; i < size; ++i)
+            funcs_.push_back(
+                std::make_shared<Func>(
+                    eval_funcs[i],
+                    arity(i),
+                    names[i],
+                    batch_funcs[i],
+                    BuiltinNone,
+                    stack_func(i)));
+    }
+
+    const FuncList& funcs() const {
+        return funcs_;
+    }
+
+    static unsigned arity(std::size_t index) {
+        static const unsigned arities[] = {Prims::arity...};
+        assert(index < size);
+        return arities[index];
+    }
+
+    static StackFunction stack_func(std::size_t index) {
+        static const StackFunction stack_funcs[] = {&Prims::call...};
+        assert(index < size);
+        return stack_funcs[index];
+    }
+
+    // call `index'-th primitive with arguments on the stack
+    static double call(std::size_t index, const double* top) {
+        return stack_func(index)(top);
+    }
+
+private:
+    FuncList funcs_;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef GPTEST_PROGRAM_HPP_
+#define GPTEST_PROGRAM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "dataset.hpp"
+#include "expr.hpp"
+#include "jit.hpp"
+#include "simplify.hpp"
+#include "tree.hpp"
+
+// Tree compiled to stack machine code in postfix order,
+// built-in functions are executed inline, other functions are called
+// through Func::stack_func if available, through Func::eval otherwise.
+// Arguments are pushed in reverse order, first argument of a function
+// is on top of the stack.
+// Program can be compiled to native code, interpreter is used otherwise.
+class Program {
+public:
+    enum Opcode {
+        OpTerm,   // push terminal value, arg: terminal ID
+        OpConst,  // push constant, arg: constant index
+        OpCall,   // call function, arg: function index
+        OpCallStack, // call stack function, arg: function index
+        OpPlus2,
+        OpMinus2,
+        OpMult2,
+        OpMult3,
+        OpSafeDiv2,
+        OpSin1,
+        OpCos1,
+        OpRlog1,
+        OpExp1
+    };
+
+    struct Instr {
+        std::uint16_t op;
+        std::uint16_t arity;
+        std::uint32_t arg;
+    };
+
+    typedef std::vector<Instr> Code;
+
+    explicit Program(const Tree& tree);
+
+    // compile simplified tree, constants are pushed by OpConst
+    explicit Program(const Simplified& simplified);
+
+    const Code& code() const {
+        return code_;
+    }
+
+    const std::vector<const Func*>& funcs() const {
+        return funcs_;
+    }
+
+    const std::vector<double>& consts() const {
+        return consts_;
+    }
+
+    // max. number of values on the stack
+    std::size_t stack_size() const {
+        return stack_size_;
+    }
+
+    // compile to native code if supported, returns true on success
+    bool compile_native();
+
+    bool has_native() const {
+        return static_cast<bool>(native_);
+    }
+
+    double eval(const Params& params) const;
+
+    // write values for all cases of `dataset' to `out'
+    void eval(const Dataset& dataset, double* out) const;
+
+    // write values for cases [begin, end) to `out'
+    void eval(
+        const Dataset& dataset,
+        std::size_t begin,
+        std::size_t end,
+        double* out) const;
+
+private:
+    // append instruction for expression node,
+    // `depth' is number of values on the stack
+    void add(const Expr* expr, unsigned arity, std::size_t& depth);
+
+    void add_const(double value, std::size_t& depth);
+
+    // `columns[k][row]' is k-th terminal value,
+    // `args' is used for non-builtin function arguments
+    double run(
+        const double* const* columns,
+        std::size_t row,
+        double* stack,
+        Params& args) const;
+
+    Code code_;
+    std::vector<const Func*> funcs_; // non-builtin functions
+    std::vector<double> consts_;
+    std::size_t stack_size_;
+    std::shared_ptr<const NativeCode> native_;
+};
+
+#endif
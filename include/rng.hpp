@@ -0,0 +1,83 @@
+#ifndef GPTEST_RNG_HPP_
+#define GPTEST_RNG_HPP_
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+// xoshiro256** engine (Blackman, Vigna), 256 bits of state,
+// state is filled from seed using splitmix64.
+// Satisfies UniformRandomBitGenerator, can be used
+// with standard distributions.
+class Xoshiro256 {
+public:
+    typedef std::uint64_t result_type;
+    typedef std::array<std::uint64_t, 4> State;
+
+    explicit Xoshiro256(std::uint64_t seed = 0) {
+        this->seed(seed);
+    }
+
+    void seed(std::uint64_t seed);
+
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        result_type result = rotl(s_[1] * 5, 7) * 9;
+        std::uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // state can be saved to continue the sequence later
+    const State& state() const {
+        return s_;
+    }
+
+    // throws std::invalid_argument if state is all zeros
+    void set_state(const State& state);
+
+    bool operator==(const Xoshiro256& other) const {
+        return s_ == other.s_;
+    }
+
+    bool operator!=(const Xoshiro256& other) const {
+        return !(*this == other);
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    State s_;
+};
+
+// Random number engine used for tree generation and breeding
+typedef Xoshiro256 Rng;
+
+// Engine of calling thread seeded from std::random_device,
+// used by functions called without an engine, runs using it
+// cannot be replayed
+Rng& default_rng();
+
+// Engine for stream (`stream1', `stream2') of `seed',
+// e.g. generation and chunk of offspring
+Rng make_rng(
+    std::uint64_t seed,
+    std::uint64_t stream1,
+    std::uint64_t stream2 = 0);
+
+#endif
@@ -2,19 +2,85 @@
 #define GPTEST_RUN_HPP_
 
 #include <cstddef>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
 #include <utility>
+#include "arena.hpp"
+#include "cache.hpp"
+#include "dag.hpp"
+#include "dataset.hpp"
+#include "eval.hpp"
 #include "expr.hpp"
+#include "func.hpp"
 #include "indiv.hpp"
+#include "pool.hpp"
+#include "rng.hpp"
 
 class Run {
 public:
+    enum EvalMode {
+        EvalBatch,   // column-wise, see BatchEval
+        EvalProgram, // compiled program, see Program
+        EvalNative   // program compiled to native code, see NativeCode
+    };
+
+    enum SimplifyMode {
+        SimplifyNone,
+        SimplifyProgram, // evaluate simplified programs, trees are
+                         // kept (EvalProgram and EvalNative modes)
+        SimplifyTree     // replace trees of new individuals with
+                         // simplified trees before evaluation
+    };
+
+    enum SampleMode {
+        SampleAll,       // all fitness cases
+        SampleMiniBatch, // random subset of cases
+        SampleDss        // dynamic subset selection, difficult cases
+                         // and cases not used recently are preferred
+    };
+
+    // evaluations of current generation
+    struct EvalStats {
+        std::size_t new_num; // individuals without fitness
+        std::size_t cache_hits; // fitness found in fitness cache
+        std::size_t duplicates; // same tree as another new individual
+    };
+
     Run()
         : population_size_(0),
           generation_number_(0),
           crossover_rate_(0.9),
+          parsimony_(ParsimonyNone),
+          parsimony_coefficient_(0.0),
           fitness_goal_(0.01),
+          subtree_cache_(0),
+          fitness_cache_(0),
+          eval_stats_(),
           fitness_combine_method_(fitness_combine_sum_abs),
-          generation_(0) {}
+          generation_(0),
+          use_arena_(false),
+          eval_mode_(EvalBatch),
+          native_threshold_(1000),
+          eval_unique_subtrees_(false),
+          simplify_(SimplifyNone),
+          racing_(false),
+          racing_percentile_(0.9),
+          race_bound_(std::numeric_limits<double>::infinity()),
+          sample_mode_(SampleAll),
+          sample_size_(0),
+          sample_stale_(true),
+          hit_tolerance_(0.01),
+          errors_case_num_(0),
+          seed_(std::random_device()()),
+          rng_(seed_),
+          arena_index_(0)
+    {
+        for (auto& arenas : arenas_)
+            arenas.emplace_back(new Arena());
+    }
 
     bool finished();
 
@@ -24,6 +90,13 @@ public:
 
     Population harvest();
 
+    // copies of `n' fittest individuals
+    Population emigrants(std::size_t n);
+
+    // replace least fit individuals with `migrants',
+    // migrants are re-evaluated
+    void immigrate(const Population& migrants);
+
     double avg_fitness();
 
     std::pair<double, double> best_worst_fitness();
@@ -32,14 +105,21 @@ public:
         generation_number_ = generation_number;
     }
 
+    // individuals are re-evaluated to fill error matrix
     void set_population(const Population& population) {
         population_ = population;
         population_size_ = population_.size();
+        for (auto& indiv : population_)
+            indiv.reset_fitness();
+        eval_stats_ = EvalStats();
     }
 
     void set_population(Population&& population) {
-        population_ = population;
+        population_ = std::move(population);
         population_size_ = population_.size();
+        for (auto& indiv : population_)
+            indiv.reset_fitness();
+        eval_stats_ = EvalStats();
     }
 
     const Population& population() const {
@@ -54,8 +134,42 @@ public:
         crossover_rate_ = crossover_rate;
     }
 
+    float crossover_rate() const {
+        return crossover_rate_;
+    }
+
+    // crossover offspring exceeding limits is bred again,
+    // first parent is copied if no offspring fits
+    void set_tree_limits(const TreeLimits& tree_limits) {
+        tree_limits_ = tree_limits;
+    }
+
+    const TreeLimits& tree_limits() const {
+        return tree_limits_;
+    }
+
+    // parsimony pressure in tournament selection,
+    // `coefficient' is used in ParsimonyCoefficient mode
+    void set_parsimony(ParsimonyMode parsimony, double coefficient = 0.0) {
+        parsimony_ = parsimony;
+        parsimony_coefficient_ = coefficient;
+    }
+
+    ParsimonyMode parsimony() const {
+        return parsimony_;
+    }
+
+    double parsimony_coefficient() const {
+        return parsimony_coefficient_;
+    }
+
     void set_fitness_goal(double fitness_goal) {
         fitness_goal_ = fitness_goal;
+        full_indivs_.clear();
+    }
+
+    double fitness_goal() const {
+        return fitness_goal_;
     }
 
     void add_terminal(int id, const std::string& name) {
@@ -75,7 +189,25 @@ public:
         unsigned arity,
         std::string name)
     {
-        functions_.push_back(std::make_shared<Func>(f, arity, name));
+        functions_.push_back(
+            std::make_shared<Func>(
+                f, arity, name,
+                find_batch_function(f),
+                find_builtin(f)));
+    }
+
+    void add_function(
+        std::function<double(const Params&)> f,
+        BatchFunction batch_f,
+        unsigned arity,
+        std::string name)
+    {
+        functions_.push_back(std::make_shared<Func>(f, arity, name, batch_f));
+    }
+
+    // add functions sharing expressions, e.g. PrimitiveSet::funcs()
+    void add_functions(const FuncList& functions) {
+        functions_.insert(functions_.end(), functions.begin(), functions.end());
     }
 
     const FuncList& functions() {
@@ -87,33 +219,320 @@ public:
     }
 
     void add_fitness_case(const Params& params, double target) {
+        if (dataset_.mapped())
+            throw std::logic_error("Fitness cases are loaded from file");
         fitness_cases_.emplace_back(params, target);
     }
 
-    void set_fitness_combine_method(
-        std::function<double(std::vector<double>)> method)
-    {
+    // map fitness cases from dataset file (see Dataset),
+    // replaces cases added by add_fitness_case
+    void load_dataset(const std::string& path);
+
+    // fitness cases by column, rebuilt from cases added
+    // by add_fitness_case if needed
+    const Dataset& dataset() {
+        update_dataset();
+        return dataset_;
+    }
+
+    void set_fitness_combine_method(FitnessCombine method) {
         fitness_combine_method_ = method;
+        fitness_cache_.clear();
+        full_indivs_.clear();
+    }
+
+    const FitnessCombine& fitness_combine_method() const {
+        return fitness_combine_method_;
+    }
+
+    // Deviations of `index'-th individual from targets for cases
+    // it was last evaluated on (sample when sampling, see
+    // set_sampling), `errors_case_num()' values.
+    // Only first values are set if fitness is bounded, see set_racing.
+    const double* errors(std::size_t index) const {
+        assert(index < population_.size());
+        assert(population_[index].has_fitness());
+        return errors_.data() + index * errors_case_num_;
+    }
+
+    std::size_t errors_case_num() const {
+        return errors_case_num_;
     }
 
     unsigned generation() {
         return generation_;
     }
 
+    // allocate trees of each generation in a separate arena,
+    // released when the generation is replaced
+    void set_use_arena(bool use_arena) {
+        use_arena_ = use_arena;
+    }
+
+    bool use_arena() const {
+        return use_arena_;
+    }
+
+    void set_eval_mode(EvalMode eval_mode) {
+        eval_mode_ = eval_mode;
+    }
+
+    EvalMode eval_mode() const {
+        return eval_mode_;
+    }
+
+    // min. number of fitness cases to compile programs to native code
+    // in EvalNative mode, interpreter is used for fewer cases
+    void set_native_threshold(std::size_t native_threshold) {
+        native_threshold_ = native_threshold;
+    }
+
+    std::size_t native_threshold() const {
+        return native_threshold_;
+    }
+
+    // evaluate each unique subtree of new individuals once
+    // per fitness case using hash-consed subtree store
+    void set_eval_unique_subtrees(bool eval_unique_subtrees) {
+        eval_unique_subtrees_ = eval_unique_subtrees;
+    }
+
+    bool eval_unique_subtrees() const {
+        return eval_unique_subtrees_;
+    }
+
+    // simplify new individuals before evaluation, see Simplified
+    void set_simplify(SimplifyMode simplify) {
+        simplify_ = simplify;
+    }
+
+    SimplifyMode simplify() const {
+        return simplify_;
+    }
+
+    // cache subtree values across generations (EvalBatch mode),
+    // `capacity' is memory limit in bytes, 0 to disable
+    void set_subtree_cache(std::size_t capacity) {
+        subtree_cache_.set_capacity(capacity);
+        if (capacity == 0)
+            subtree_cache_.clear();
+    }
+
+    SubtreeCache& subtree_cache() {
+        return subtree_cache_;
+    }
+
+    // Cache fitness of trees across generations, new individuals
+    // with the same tree as a cached one or as another new individual
+    // are not evaluated; not used when sampling, bounded fitness
+    // is not cached. `capacity' is memory limit in bytes, 0 to disable
+    void set_fitness_cache(std::size_t capacity) {
+        fitness_cache_.set_capacity(capacity);
+        if (capacity == 0)
+            fitness_cache_.clear();
+    }
+
+    FitnessCache& fitness_cache() {
+        return fitness_cache_;
+    }
+
+    // reset for each generation
+    const EvalStats& eval_stats() const {
+        return eval_stats_;
+    }
+
+    // stop evaluating new individuals once their partial error
+    // exceeds fitness of given percentile of previous generation,
+    // only for built-in combine methods, subtree cache is not used
+    void set_racing(bool racing) {
+        racing_ = racing;
+        race_bound_ = std::numeric_limits<double>::infinity();
+    }
+
+    bool racing() const {
+        return racing_;
+    }
+
+    void set_racing_percentile(double racing_percentile) {
+        if (!(0.0 < racing_percentile && racing_percentile <= 1.0))
+            throw std::invalid_argument("Percentile must be in (0, 1]");
+        racing_percentile_ = racing_percentile;
+    }
+
+    // current early-abort bound
+    double race_bound() const {
+        return race_bound_;
+    }
+
+    // evaluate population on a new sample of `sample_size' cases
+    // each generation, fitness is relative to the sample,
+    // harvest() and solution_found() re-evaluate candidates
+    // on all cases
+    void set_sampling(SampleMode sample_mode, std::size_t sample_size);
+
+    SampleMode sample_mode() const {
+        return sample_mode_;
+    }
+
+    std::size_t sample_size() const {
+        return sample_size_;
+    }
+
+    // max. deviation for a case to count as solved (SampleDss mode)
+    void set_hit_tolerance(double hit_tolerance) {
+        hit_tolerance_ = hit_tolerance;
+    }
+
+    // offspring of each generation only depend on the seed,
+    // not on number of threads
+    void set_seed(std::uint64_t seed) {
+        seed_ = seed;
+        rng_.seed(seed);
+    }
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    // engine seeded by set_seed, used for case sampling,
+    // initial population and fitness cases should be generated
+    // with it for a run to be replayed from its seed
+    Rng& rng() {
+        return rng_;
+    }
+
+    // evaluate and breed individuals on `thread_num' threads,
+    // 0 for number of hardware threads, 1 to evaluate serially;
+    // subtree cache is not used by multiple threads
+    void set_thread_num(std::size_t thread_num);
+
+    std::size_t thread_num() const {
+        return pool_ ? pool_->thread_num() : 1;
+    }
+
+    // unique subtrees of individuals evaluated last
+    const Dag& subtrees() const {
+        return subtrees_;
+    }
+
+    // Binary snapshot of run state: parameters, generation counter,
+    // seed and engine state, sampling state, population with fitness
+    // and errors. Terminals and functions are stored by name,
+    // fitness cases by size and checksum. Thread number, caches
+    // and fitness combine method are not stored.
+    std::string checkpoint();
+
+    // Continue run from checkpoint(), terminals, functions and
+    // fitness cases must be set up as in the saved run, parameters
+    // are replaced with saved ones. Throws std::runtime_error
+    // if data is invalid or does not match the run.
+    void restore(const std::string& data);
+
+    // write checkpoint to file atomically,
+    // see also Checkpointer for writing in background
+    void save_checkpoint(const std::string& path);
+
+    void load_checkpoint(const std::string& path);
+
 private:
     void validate();
 
+    // rebuild dataset from fitness cases if needed
+    void update_dataset();
+
+    // true if population is evaluated on a subset of cases
+    bool sampling() const {
+        return sample_mode_ != SampleAll
+            && sample_size_ < dataset_.case_num();
+    }
+
+    // select sample for current generation
+    void update_sample();
+
+    // update DSS case difficulty using errors of last evaluation
+    void update_difficulty();
+
     void eval_population();
 
+    // set fitness of individuals to evaluate found in fitness cache
+    // or among other individuals, remove them from `eval_rows_'
+    void find_cached_fitness();
+
+    // add evaluated individuals to fitness cache,
+    // copy fitness to duplicates
+    void cache_fitness();
+
+    // evaluate unique subtrees of `eval_rows_' column-wise over all
+    // cases, racing and subtree cache are not used
+    void eval_population_unique_subtrees(const Dataset& dataset);
+
+    void eval_indiv(
+        Indiv& indiv,
+        const Dataset& dataset,
+        BatchEval& evaluator,
+        double* errors,
+        double bound);
+
+    // copy of `index'-th individual evaluated on all cases, evaluation
+    // stops early if it cannot reach fitness goal; result is kept
+    // while the tree, fitness cases and fitness goal are the same
+    const Indiv& eval_full(std::size_t index);
+
+    void update_race_bound();
+
     std::size_t population_size_;
     unsigned generation_number_;
     float crossover_rate_;
+    TreeLimits tree_limits_;
+    ParsimonyMode parsimony_;
+    double parsimony_coefficient_;
     double fitness_goal_;
     TermList terminals_;
     FuncList functions_;
     FitnessCaseList fitness_cases_;
+    Dataset dataset_; // fitness cases by column
+    BatchEval evaluator_;
+    SubtreeCache subtree_cache_;
+    FitnessCache fitness_cache_;
+    EvalStats eval_stats_;
+    std::vector<std::size_t> eval_rows_; // individuals to evaluate
+    std::vector<std::uint64_t> eval_hashes_; // tree hashes of eval_rows_
+    // (duplicate, evaluated individual) rows
+    std::vector<std::pair<std::size_t, std::size_t>> duplicates_;
     FitnessCombine fitness_combine_method_;
     unsigned generation_;
+    bool use_arena_;
+    EvalMode eval_mode_;
+    std::size_t native_threshold_;
+    bool eval_unique_subtrees_;
+    SimplifyMode simplify_;
+    bool racing_;
+    double racing_percentile_;
+    double race_bound_;
+    SampleMode sample_mode_;
+    std::size_t sample_size_;
+    bool sample_stale_; // new sample is needed
+    Dataset sample_;
+    std::vector<std::size_t> sample_rows_; // sampled case positions
+    std::vector<std::size_t> case_order_; // mini-batch shuffle
+    std::vector<double> case_difficulty_; // DSS
+    std::vector<double> case_age_; // DSS, generations since selected
+    double hit_tolerance_;
+    // deviations, individual x case, see errors()
+    std::vector<double> errors_;
+    std::vector<double> errors_next_;
+    std::size_t errors_case_num_;
+    std::vector<double> full_errors_; // see eval_full
+    Population full_indivs_; // by row, see eval_full
+    std::uint64_t seed_;
+    Rng rng_; // case sampling
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<BatchEval> evaluators_; // one per thread
+    Dag subtrees_;
+    // arenas for current and next generations, one per thread,
+    // declared before populations to outlive them
+    std::vector<std::unique_ptr<Arena>> arenas_[2];
+    std::size_t arena_index_;
     Population population_;
     Population population_next_;
 };
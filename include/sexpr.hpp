@@ -0,0 +1,52 @@
+#ifndef GPTEST_SEXPR_HPP_
+#define GPTEST_SEXPR_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "expr.hpp"
+#include "tree.hpp"
+
+// Parses trees written by Tree::as_string and Tree::write,
+// e.g. (+ a (sin a)), resolving names against terminal and
+// function lists. Input is read in place, missing nodes
+// are written as [empty].
+class TreeParser {
+public:
+    // throws std::invalid_argument if terminal or function
+    // names are not unique
+    TreeParser(const TermList& term_list, const FuncList& func_list);
+
+    // Parse tree at `pos' (leading whitespace is skipped),
+    // `pos' is set past the tree. Throws std::runtime_error
+    // on syntax error, unknown name or wrong number of arguments
+    Tree parse(
+        const char*& pos,
+        const char* end,
+        const Tree::Allocator& alloc = Tree::Allocator()) const;
+
+    // whole string must be a single tree
+    Tree parse(
+        const std::string& s,
+        const Tree::Allocator& alloc = Tree::Allocator()) const;
+
+private:
+    // Expressions by name, open addressing with linear probing,
+    // names are looked up in place
+    class NameTable {
+    public:
+        // throws std::invalid_argument if names are not unique
+        NameTable(const std::vector<const Expr*>& exprs, const char* kind);
+
+        // nullptr if not found
+        const Expr* find(const char* name, std::size_t size) const;
+
+    private:
+        std::vector<const Expr*> slots_; // size is a power of 2
+    };
+
+    NameTable terms_;
+    NameTable funcs_;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef GPTEST_SIMPLIFY_HPP_
+#define GPTEST_SIMPLIFY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "expr.hpp"
+#include "tree.hpp"
+
+// Simplified form of a tree with constant nodes, for evaluation
+// (see Program) and display; the tree itself is not modified.
+// Subtrees without terminals are folded into constants, functions
+// are assumed to be pure. Rules for built-in functions:
+//   (+ x 0), (+ 0 x), (- x 0), (* x 1), (* 1 x), (% x 1) -> x
+//   (* x (% x x)), (* (% x x) x) -> x
+//   (- x x), (* x 0), (* 0 x), (% x 0), (% 0 x), (* ... 0 ...) -> 0
+// Rules assume finite values, results can differ from the tree
+// where a removed subtree is infinite or NaN.
+class Simplified {
+public:
+    struct Node {
+        const Expr* expr; // nullptr for constant
+        double value; // constant value
+        std::uint32_t size; // subtree size
+        std::uint16_t arity;
+        std::uint32_t source; // position of equivalent subtree in tree
+    };
+
+    typedef std::vector<Node> NodeList;
+
+    // throws std::invalid_argument if tree is not valid
+    explicit Simplified(const Tree& tree);
+
+    // nodes in prefix order
+    const NodeList& nodes() const {
+        return nodes_;
+    }
+
+    std::size_t size() const {
+        return nodes_.size();
+    }
+
+    // true if whole tree is a constant
+    bool constant() const {
+        return !nodes_[0].expr;
+    }
+
+    double value() const {
+        return nodes_[0].value;
+    }
+
+    // Tree built from simplified form, constants are replaced
+    // with subtrees of the original tree they were folded from
+    Tree tree(const Tree::Allocator& alloc = Tree::Allocator()) const;
+
+    std::string as_string() const;
+
+private:
+    // append simplified subtree at `pos'
+    void build(std::size_t pos);
+
+    std::string do_as_string(std::size_t& pos) const;
+
+    Tree tree_;
+    NodeList nodes_;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef GPTEST_STEADY_HPP_
+#define GPTEST_STEADY_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "dataset.hpp"
+#include "eval.hpp"
+#include "indiv.hpp"
+#include "run.hpp"
+
+// Asynchronous steady-state evolution: threads repeatedly select
+// parents by tournament, breed and evaluate an offspring and put it
+// in place of the loser of an inverse tournament, with no barrier
+// between generations.
+// Each population slot has its own lock, held only to copy or replace
+// the individual; trees are shared by reference, evaluation is done
+// without locks.
+// An offspring replaces an individual only if it is at least as fit,
+// the slot may have been replaced by another thread meanwhile.
+// Progress is counted in evaluations (reproduced offspring count too).
+// Results only depend on the seed when using a single thread.
+class SteadyState {
+public:
+    // `run' provides terminals, functions, fitness cases, initial
+    // population, fitness goal, crossover rate, combine method and
+    // evaluation mode, must outlive the engine; sampling, subtree
+    // cache and arenas are not used, with racing offspring evaluation
+    // stops once it cannot beat the individual to be replaced
+    explicit SteadyState(Run& run);
+
+    SteadyState(const SteadyState&) = delete;
+
+    SteadyState& operator=(const SteadyState&) = delete;
+
+    // stop after `evaluation_number' evaluations
+    void set_evaluation_number(std::size_t evaluation_number) {
+        evaluation_number_ = evaluation_number;
+    }
+
+    // 0 for number of hardware threads
+    void set_thread_num(std::size_t thread_num);
+
+    std::size_t thread_num() const {
+        return thread_num_;
+    }
+
+    void set_seed(std::uint64_t seed) {
+        seed_ = seed;
+    }
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    // number of offspring evaluated so far
+    std::size_t evaluations() const {
+        return evaluations_;
+    }
+
+    bool finished();
+
+    bool solution_found();
+
+    // breed up to `evaluation_num' offspring, stops early if finished
+    void advance(std::size_t evaluation_num);
+
+    // advance until finished
+    void run() {
+        advance(std::numeric_limits<std::size_t>::max());
+    }
+
+    Population harvest();
+
+    double avg_fitness();
+
+    std::pair<double, double> best_worst_fitness();
+
+    const Population& population() const {
+        return population_;
+    }
+
+    std::size_t population_size() const {
+        return population_.size();
+    }
+
+private:
+    // per thread state
+    struct Worker {
+        BatchEval evaluator;
+        std::vector<double> errors;
+    };
+
+    // call `task(thread)' on each thread and wait
+    void run_threads(const std::function<void(std::size_t thread)>& task);
+
+    void eval_population();
+
+    void eval(
+        Indiv& indiv,
+        const Dataset& dataset,
+        Worker& worker,
+        double bound);
+
+    // copy of individual in slot `index'
+    Indiv get(std::size_t index);
+
+    // breed and place one offspring
+    void step(const Dataset& dataset, Rng& rng, Worker& worker);
+
+    Run& run_;
+    std::size_t evaluation_number_;
+    std::size_t thread_num_;
+    std::uint64_t seed_;
+    std::size_t advance_num_; // random streams of each advance differ
+    std::atomic<std::size_t> evaluations_;
+    std::size_t limit_; // evaluations of current advance
+    std::atomic<bool> stop_; // solution found or error
+    bool evaluated_;
+    std::vector<Worker> workers_;
+    Population population_;
+    std::vector<std::mutex> locks_; // one per slot
+};
+
+#endif
@@ -2,97 +2,266 @@
 #define GPTEST_TREE_HPP_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <random>
 #include <stdexcept>
 #include <string>
 #include <vector>
+#include "arena.hpp"
 #include "expr.hpp"
-
+#include "rng.hpp"
+
+// Tree is stored as a flat list of nodes in prefix (Polish) order,
+// every subtree occupies a contiguous range of the list.
+// Nodes keep raw pointers to expressions, so terminal and function
+// lists used to build a tree must outlive it.
+// Subtree sizes and heights are cached in nodes, positions of
+// function and terminal nodes are indexed, both are kept up to date
+// on subtree replacement.
+// Node data is immutable and reference counted, copies of a tree share
+// it, modifications make a new copy (single allocation).
+// Node data can be allocated in an arena, copies made by copy
+// constructor are allocated on heap.
 class Tree  {
 public:
+    struct Node {
+        explicit Node(const Expr* expr = nullptr)
+            : expr(expr),
+              size(1),
+              arity(expr ? expr->arity() : 0),
+              height(0) {}
+
+        const Expr* expr; // nullptr for missing child
+        std::uint32_t size; // subtree size
+        std::uint16_t arity;
+        std::uint16_t height; // subtree height
+    };
+
+    typedef ArenaAllocator<Node> Allocator;
+    typedef std::vector<Node> NodeList;
+
     Tree()
-        : parent_(nullptr),
-          expr_(nullptr),
-          children_(0) {}
+        : data_(nullptr) {}
+
+    explicit Tree(const std::shared_ptr<Expr>& expr);
 
-    explicit Tree(const std::shared_ptr<Expr>& expr)
-        : parent_(nullptr),
-          expr_(expr),
-          children_(expr_ ? expr_->arity() : 0) {}
+    // sizes and heights of nodes are recalculated
+    explicit Tree(const NodeList& nodes, const Allocator& alloc = Allocator());
 
     Tree(const Tree& other);
 
-    Tree(Tree&& other);
+    // share data if allocated using `alloc', copy otherwise
+    Tree(const Tree& other, const Allocator& alloc);
+
+    Tree(Tree&& other) noexcept
+        : data_(other.data_)
+    {
+        other.data_ = nullptr;
+    }
+
+    ~Tree() {
+        release();
+    }
 
     Tree& operator=(const Tree& other);
 
-    Tree& operator=(Tree&& other);
+    Tree& operator=(Tree&& other) noexcept;
 
     bool empty() const {
-        return !expr_;
+        return !data_ || !data_->nodes()[0].expr;
     }
 
     bool valid() const;
 
-    bool root() const {
-        return !parent_;
+    Allocator allocator() const {
+        return Allocator(data_ ? data_->arena : nullptr);
+    }
+
+    // number of trees sharing node data
+    std::size_t use_count() const {
+        return data_ ? data_->refs.load() : 0;
     }
 
     double get_value(const Params& params) const;
 
     std::size_t child_num() const {
-        return children_.size();
+        return data_ ? data_->nodes()[0].arity : 0;
+    }
+
+    std::size_t size() const {
+        return data_ ? data_->index_num : 0;
+    }
+
+    std::size_t term_num() const {
+        return data_ ? data_->index_num - data_->func_num : 0;
+    }
+
+    std::size_t func_num() const {
+        return data_ ? data_->func_num : 0;
+    }
+
+    unsigned depth() const {
+        return data_ ? data_->nodes()[0].height : 0;
     }
 
-    std::size_t size() {
-        return term_num() + func_num();
+    // number of nodes including missing children
+    std::size_t node_num() const {
+        return data_ ? data_->node_num : 0;
     }
 
-    std::size_t term_num() const;
+    const Node* begin() const {
+        return data_ ? data_->nodes() : nullptr;
+    }
 
-    std::size_t func_num() const;
+    const Node* end() const {
+        return begin() + node_num();
+    }
 
-    void set_child(std::size_t index, Tree subtree);
+    const Node& node(std::size_t pos) const {
+        assert(pos < node_num());
+        return data_->nodes()[pos];
+    }
 
-    Tree& random_subtree(float p_term = 0.1);
+    // position past the end of subtree at pos
+    std::size_t subtree_end(std::size_t pos) const {
+        if (pos >= node_num())
+            throw std::out_of_range("Invalid node position");
+        return pos + data_->nodes()[pos].size;
+    }
 
-    const Tree& random_subtree(float p_term = 0.1) const;
+    // number of edges from root to node at pos
+    unsigned node_depth(std::size_t pos) const;
 
-    Tree& random_term();
+    Tree subtree(std::size_t pos) const;
 
-    const Tree& random_term() const;
+    void set_child(std::size_t index, const Tree& subtree);
 
-    Tree& nth_term(std::size_t n);
+    void replace_subtree(std::size_t pos, const Tree& subtree);
 
-    const Tree& nth_term(std::size_t n) const;
+    std::size_t random_subtree(float p_term, Rng& rng) const;
 
-    Tree& random_func();
+    std::size_t random_subtree(float p_term = 0.1) const {
+        return random_subtree(p_term, default_rng());
+    }
 
-    const Tree& random_func() const;
+    std::size_t random_term(Rng& rng) const;
 
-    Tree& nth_func(std::size_t n);
+    std::size_t random_term() const {
+        return random_term(default_rng());
+    }
 
-    const Tree& nth_func(std::size_t n) const;
+    std::size_t nth_term(std::size_t n) const {
+        if (n >= term_num())
+            throw std::out_of_range("Terminal number is out of range");
+        return data_->index()[data_->func_num + n];
+    }
 
-    std::string as_string() const;
+    std::size_t random_func(Rng& rng) const;
 
-    std::string as_pretty_string() const {
-        return do_as_pretty_string(0);
+    std::size_t random_func() const {
+        return random_func(default_rng());
     }
 
-private:
-    std::string do_as_pretty_string(std::size_t offset) const;
+    std::size_t nth_func(std::size_t n) const {
+        if (n >= func_num())
+            throw std::out_of_range("Function number is out of range");
+        return data_->index()[n];
+    }
 
-    Tree* parent_;
-    std::shared_ptr<Expr> expr_;
-    std::vector<Tree> children_;
-};
+    // S-expression, e.g. (+ a (sin a)), see also TreeParser
+    std::string as_string() const;
+
+    // write as_string() form to `out' without intermediate strings
+    void write(std::ostream& out) const;
 
-Tree full(const TermList& term_list, const FuncList& func_list, unsigned depth);
+    // write as_string() form to `buffer' of `size' chars without
+    // terminating null, returns length of the whole form,
+    // output is truncated if it is longer than `size'
+    std::size_t write(char* buffer, std::size_t size) const;
+
+    std::string as_pretty_string() const;
+
+private:
+    // Header of node data block, followed by the node list and
+    // function and terminal node positions (function positions first)
+    struct Data {
+        std::atomic<std::size_t> refs;
+        Arena* arena; // nullptr if allocated on heap
+        std::uint32_t node_num;
+        std::uint32_t index_num;
+        std::uint32_t func_num;
+
+        Node* nodes() {
+            return reinterpret_cast<Node*>(this + 1);
+        }
+
+        const Node* nodes() const {
+            return reinterpret_cast<const Node*>(this + 1);
+        }
+
+        std::uint32_t* index() {
+            return reinterpret_cast<std::uint32_t*>(nodes() + node_num);
+        }
+
+        const std::uint32_t* index() const {
+            return reinterpret_cast<const std::uint32_t*>(
+                nodes() + node_num);
+        }
+    };
+
+    friend Tree splice(
+        const Tree& recipient,
+        std::size_t pos,
+        const Tree& donor,
+        std::size_t donor_pos,
+        const Allocator& alloc);
+
+    // node data for `node_num' nodes, reference count is set to 1
+    static Data* allocate(std::size_t node_num, Arena* arena);
+
+    void release();
+
+    // recalculate sizes and heights of all nodes
+    void update_nodes();
+
+    // update sizes and heights of ancestors of node at `pos'
+    // after its subtree size changed by `delta'
+    void update_path(std::size_t ancestor, std::size_t pos, long delta);
+
+    // rebuild function and terminal node positions
+    void update_index();
+
+    std::string do_as_pretty_string(
+        std::size_t& pos,
+        std::size_t offset) const;
+
+    Data* data_;
+};
 
-Tree grow(const TermList& term_list, const FuncList& func_list, unsigned depth);
+// Make a copy of `recipient' with subtree at `pos' replaced by
+// subtree of `donor' at `donor_pos'
+Tree splice(
+    const Tree& recipient,
+    std::size_t pos,
+    const Tree& donor,
+    std::size_t donor_pos,
+    const Tree::Allocator& alloc = Tree::Allocator());
+
+Tree full(
+    const TermList& term_list,
+    const FuncList& func_list,
+    unsigned depth,
+    Rng& rng = default_rng());
+
+Tree grow(
+    const TermList& term_list,
+    const FuncList& func_list,
+    unsigned depth,
+    Rng& rng = default_rng());
 
 #endif
@@ -0,0 +1,146 @@
+#ifndef GPTEST_WIRE_HPP_
+#define GPTEST_WIRE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "expr.hpp"
+#include "indiv.hpp"
+#include "tree.hpp"
+
+// Little-endian binary encoding of values,
+// appended to a byte string
+class WireWriter {
+public:
+    explicit WireWriter(std::string& out)
+        : out_(out) {}
+
+    void put_u8(std::uint8_t value) {
+        out_.push_back(static_cast<char>(value));
+    }
+
+    void put_u16(std::uint16_t value);
+
+    void put_u32(std::uint32_t value);
+
+    void put_u64(std::uint64_t value);
+
+    void put_double(double value);
+
+    // unsigned LEB128, 1 byte for values below 128
+    void put_varint(std::uint64_t value);
+
+    // 4-byte length and bytes
+    void put_string(const std::string& value);
+
+private:
+    std::string& out_;
+};
+
+// Reads values written by WireWriter,
+// throws std::runtime_error at end of data
+class WireReader {
+public:
+    WireReader(const char* data, std::size_t size)
+        : pos_(data),
+          end_(data + size) {}
+
+    explicit WireReader(const std::string& data)
+        : WireReader(data.data(), data.size()) {}
+
+    std::uint8_t get_u8();
+
+    std::uint16_t get_u16();
+
+    std::uint32_t get_u32();
+
+    std::uint64_t get_u64();
+
+    double get_double();
+
+    // throws std::runtime_error if value is longer than 64 bits
+    std::uint64_t get_varint();
+
+    std::string get_string();
+
+    bool at_end() const {
+        return pos_ == end_;
+    }
+
+    // number of bytes left
+    std::size_t remaining() const {
+        return end_ - pos_;
+    }
+
+private:
+    const unsigned char* take(std::size_t size);
+
+    const char* pos_;
+    const char* end_;
+};
+
+// Compact prefix encoding of trees: varint node number, then code
+// of each node, 1 byte if there are at most 256 codes, 2 bytes
+// otherwise. Code 0 - missing node, 1 + k - k-th terminal,
+// 1 + terminal number + k - k-th function.
+// Codes follow positions in terminal and function lists, both sides
+// must use lists with the same order or pass the code table
+// (expression names) with the data.
+class TreeCodec {
+public:
+    TreeCodec(const TermList& term_list, const FuncList& func_list);
+
+    // codes from table written by write_table, names are resolved
+    // against the lists; throws std::runtime_error if table
+    // is invalid or an expression is not found
+    TreeCodec(
+        WireReader& reader,
+        const TermList& term_list,
+        const FuncList& func_list);
+
+    // names of terminals and functions (with arity) in code order
+    void write_table(WireWriter& writer) const;
+
+    // throws std::invalid_argument if tree has unknown expression
+    void write(WireWriter& writer, const Tree& tree) const;
+
+    // throws std::runtime_error if data is invalid
+    Tree read(
+        WireReader& reader,
+        const Tree::Allocator& alloc = Tree::Allocator()) const;
+
+private:
+    // next code for `expr'
+    void add(const Expr* expr);
+
+    std::vector<const Expr*> exprs_; // by code
+    std::size_t term_num_;
+    std::unordered_map<const Expr*, std::uint16_t> codes_;
+};
+
+// Encodes individuals: flags, fitness and tree (see TreeCodec)
+class IndivCodec {
+public:
+    IndivCodec(const TermList& term_list, const FuncList& func_list)
+        : tree_codec_(term_list, func_list) {}
+
+    explicit IndivCodec(const TreeCodec& tree_codec)
+        : tree_codec_(tree_codec) {}
+
+    void write(WireWriter& writer, const Indiv& indiv) const;
+
+    void write(WireWriter& writer, const Population& population) const;
+
+    // throws std::runtime_error if data is invalid or tree
+    // is empty or has missing nodes
+    Indiv read_indiv(WireReader& reader) const;
+
+    Population read_population(WireReader& reader) const;
+
+private:
+    TreeCodec tree_codec_;
+};
+
+#endif
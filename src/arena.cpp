@@ -0,0 +1,46 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cassert>
+
+Arena::~Arena() {
+    for (auto& block : blocks_)
+        ::operator delete(block.data);
+}
+
+void* Arena::allocate(std::size_t size, std::size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    // find a block to fit requested size
+    for (; current_ < blocks_.size(); ++current_, offset_ = 0) {
+        Block& block = blocks_[current_];
+        std::size_t offset = (offset_ + align - 1) & ~(align - 1);
+        if (offset + size <= block.size) {
+            offset_ = offset + size;
+            used_ += size;
+            return block.data + offset;
+        }
+    }
+
+    // allocate new block, operator new result is suitably aligned
+    Block block;
+    block.size = std::max(block_size_, size);
+    block.data = static_cast<char*>(::operator new(block.size));
+    blocks_.push_back(block);
+    current_ = blocks_.size() - 1;
+    offset_ = size;
+    used_ += size;
+    return block.data;
+}
+
+void Arena::reset() {
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+std::size_t Arena::capacity() const {
+    std::size_t capacity = 0;
+    for (const auto& block : blocks_)
+        capacity += block.size;
+    return capacity;
+}
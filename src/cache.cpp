@@ -0,0 +1,105 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <utility>
+
+const std::size_t SubtreeCache::DefaultCapacity;
+const std::size_t SubtreeCache::DefaultMinSubtreeSize;
+const std::size_t FitnessCache::DefaultCapacity;
+
+const double* SubtreeCache::find(
+    const Tree& tree,
+    std::size_t pos,
+    std::uint64_t hash,
+    std::size_t case_num)
+{
+    const Entry* entry = cache_.find(
+        hash,
+        [&tree, pos, case_num](const Entry& entry) {
+            return matches(entry, tree, pos, case_num);
+        });
+    return entry ? entry->values.data() : nullptr;
+}
+
+void SubtreeCache::insert(
+    const Tree& tree,
+    std::size_t pos,
+    std::uint64_t hash,
+    const double* values,
+    std::size_t case_num)
+{
+    Entry entry;
+    for (std::size_t i = pos; i < tree.subtree_end(pos); ++i)
+        entry.exprs.push_back(tree.node(i).expr);
+    entry.values.assign(values, values + case_num);
+    cache_.insert(hash, std::move(entry));
+}
+
+std::size_t SubtreeCache::Entry::memory() const {
+    return sizeof(std::uint64_t) + sizeof(Entry)
+        + exprs.size() * sizeof(const Expr*)
+        + values.size() * sizeof(double);
+}
+
+bool SubtreeCache::matches(
+    const Entry& entry,
+    const Tree& tree,
+    std::size_t pos,
+    std::size_t case_num)
+{
+    if (entry.values.size() != case_num)
+        return false;
+    if (entry.exprs.size() != tree.subtree_end(pos) - pos)
+        return false;
+    for (std::size_t i = 0; i < entry.exprs.size(); ++i)
+        if (entry.exprs[i] != tree.node(pos + i).expr)
+            return false;
+    return true;
+}
+
+
+bool FitnessCache::find(
+    const Tree& tree,
+    std::uint64_t hash,
+    std::size_t case_num,
+    double& fitness,
+    double* errors)
+{
+    const Entry* entry = cache_.find(
+        hash,
+        [&tree, case_num](const Entry& entry) {
+            return entry.errors.size() == case_num
+                && entry.exprs.size() == tree.node_num()
+                && std::equal(
+                    entry.exprs.begin(), entry.exprs.end(),
+                    tree.begin(),
+                    [](const Expr* expr, const Tree::Node& node) {
+                        return expr == node.expr;
+                    });
+        });
+    if (!entry)
+        return false;
+    fitness = entry->fitness;
+    std::copy(entry->errors.begin(), entry->errors.end(), errors);
+    return true;
+}
+
+void FitnessCache::insert(
+    const Tree& tree,
+    std::uint64_t hash,
+    std::size_t case_num,
+    double fitness,
+    const double* errors)
+{
+    Entry entry;
+    for (const Tree::Node& node : tree)
+        entry.exprs.push_back(node.expr);
+    entry.fitness = fitness;
+    entry.errors.assign(errors, errors + case_num);
+    cache_.insert(hash, std::move(entry));
+}
+
+std::size_t FitnessCache::Entry::memory() const {
+    return sizeof(std::uint64_t) + sizeof(Entry)
+        + exprs.size() * sizeof(const Expr*)
+        + errors.size() * sizeof(double);
+}
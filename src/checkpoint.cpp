@@ -0,0 +1,116 @@
+#include "checkpoint.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::string error_string(const char* what, const std::string& path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+
+void write_file_atomic(const std::string& path, const std::string& data) {
+    std::string tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error(error_string("Cannot open", tmp_path));
+    const char* pos = data.data();
+    std::size_t left = data.size();
+    while (left > 0) {
+        ssize_t written = write(fd, pos, left);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0) {
+            std::string error = error_string("Cannot write", tmp_path);
+            close(fd);
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error(error);
+        }
+        pos += written;
+        left -= written;
+    }
+    // data must be on disk before the file is replaced
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        std::string error = error_string("Cannot write", tmp_path);
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error(error);
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::string error = error_string("Cannot rename", tmp_path);
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error(error);
+    }
+}
+
+std::string read_file(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(error_string("Cannot open", path));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::string error = error_string("Cannot stat", path);
+        close(fd);
+        throw std::runtime_error(error);
+    }
+    std::string data(st.st_size, '\0');
+    std::size_t size = 0;
+    while (size < data.size()) {
+        ssize_t n = read(fd, &data[size], data.size() - size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            std::string error = error_string("Cannot read", path);
+            close(fd);
+            throw std::runtime_error(error);
+        }
+        size += n;
+    }
+    close(fd);
+    return data;
+}
+
+Checkpointer::Checkpointer(Run& run, const std::string& path, unsigned interval)
+    : run_(run),
+      path_(path),
+      interval_(interval)
+{
+    if (interval < 1)
+        throw std::invalid_argument("Checkpoint interval cannot be zero");
+}
+
+Checkpointer::~Checkpointer() {
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void Checkpointer::update() {
+    if (run_.generation() % interval_ == 0)
+        save();
+}
+
+void Checkpointer::save() {
+    wait();
+    // encoding is fast compared to writing the file,
+    // the snapshot does not share trees with the run
+    std::string data = run_.checkpoint();
+    thread_ = std::thread([this](std::string data) {
+        try {
+            write_file_atomic(path_, data);
+        } catch (...) {
+            error_ = std::current_exception();
+        }
+    }, std::move(data));
+}
+
+void Checkpointer::wait() {
+    if (thread_.joinable())
+        thread_.join();
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,104 @@
+// Convert CSV file to dataset file, see Dataset.
+// Each line is a fitness case: parameter values followed by target value,
+// first line is skipped if it is not numeric (column names).
+//
+// Usage: csv2dataset input.csv output.dat
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "dataset.hpp"
+
+// returns false if line is not a list of numbers
+static bool parse_line(const std::string& line, std::vector<double>& values) {
+    values.clear();
+    const char* p = line.c_str();
+    while (true) {
+        char* end;
+        errno = 0;
+        double value = std::strtod(p, &end);
+        if (end == p || errno == ERANGE)
+            return false;
+        values.push_back(value);
+        while (*end == ' ' || *end == '\t' || *end == '\r')
+            ++end;
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+        p = end + 1;
+    }
+}
+
+static bool is_blank(const std::string& line) {
+    return line.find_first_not_of(" \t\r") == std::string::npos;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " input.csv output.dat" << std::endl;
+        return 1;
+    }
+
+    try {
+        // first pass: count cases
+        std::ifstream input(argv[1]);
+        if (!input)
+            throw std::runtime_error(std::string("Cannot open ") + argv[1]);
+        std::string line;
+        std::vector<double> values;
+        std::size_t line_num = 0;
+        std::size_t skip_num = 0; // header line
+        std::size_t case_num = 0;
+        std::size_t value_num = 0;
+        while (std::getline(input, line)) {
+            ++line_num;
+            if (is_blank(line))
+                continue;
+            if (!parse_line(line, values)) {
+                if (case_num == 0 && skip_num == 0) {
+                    skip_num = line_num;
+                    continue;
+                }
+                throw std::runtime_error(
+                    "Invalid value on line " + std::to_string(line_num));
+            }
+            if (case_num == 0)
+                value_num = values.size();
+            if (values.size() != value_num || value_num < 2)
+                throw std::runtime_error(
+                    "Invalid number of values on line "
+                    + std::to_string(line_num));
+            ++case_num;
+        }
+
+        if (case_num == 0)
+            throw std::runtime_error("No fitness cases");
+
+        // second pass: write cases
+        input.clear();
+        input.seekg(0);
+        DatasetWriter writer(argv[2], case_num, value_num - 1);
+        line_num = 0;
+        while (std::getline(input, line)) {
+            ++line_num;
+            if (line_num == skip_num || is_blank(line))
+                continue;
+            parse_line(line, values);
+            writer.add(values.data(), values.back());
+        }
+        writer.close();
+
+        std::cout << case_num << " cases, "
+                  << value_num - 1 << " parameters" << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
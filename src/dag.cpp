@@ -0,0 +1,165 @@
+#include "dag.hpp"
+#include <algorithm>
+#include <cassert>
+
+const Dag::Id Dag::NoId;
+
+static std::uint64_t mix(std::uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static std::uint64_t expr_hash(const Expr* expr, unsigned arity) {
+    return mix(reinterpret_cast<std::uintptr_t>(expr) + arity);
+}
+
+static std::uint64_t combine_hash(std::uint64_t hash, std::uint64_t child) {
+    return mix(hash ^ (child + 0x9e3779b97f4a7c15ULL + (hash << 6)));
+}
+
+void subtree_hashes(const Tree& tree, std::vector<std::uint64_t>& hashes) {
+    hashes.resize(tree.node_num());
+    // children follow their parent, so calculate in reverse order
+    std::vector<std::uint64_t> stack;
+    for (std::size_t pos = tree.node_num(); pos-- > 0;) {
+        const Tree::Node& node = tree.node(pos);
+        assert(stack.size() >= node.arity);
+        std::uint64_t hash = expr_hash(node.expr, node.arity);
+        // first child is on top of the stack
+        for (unsigned i = 0; i < node.arity; ++i) {
+            hash = combine_hash(hash, stack.back());
+            stack.pop_back();
+        }
+        stack.push_back(hash);
+        hashes[pos] = hash;
+    }
+}
+
+std::uint64_t tree_hash(const Tree& tree) {
+    std::vector<std::uint64_t> hashes;
+    subtree_hashes(tree, hashes);
+    return hashes.empty() ? 0 : hashes[0];
+}
+
+Dag::Id Dag::intern(const Tree& tree, std::vector<Id>* ids) {
+    if (tree.node_num() == 0)
+        return NoId;
+
+    if (ids)
+        ids->resize(tree.node_num());
+
+    // children follow their parent, so intern in reverse order
+    std::vector<Id> stack;
+    std::vector<Id> args;
+    for (std::size_t pos = tree.node_num(); pos-- > 0;) {
+        const Tree::Node& node = tree.node(pos);
+        assert(stack.size() >= node.arity);
+        std::uint64_t hash = expr_hash(node.expr, node.arity);
+        // first child is on top of the stack
+        args.clear();
+        for (unsigned i = 0; i < node.arity; ++i) {
+            args.push_back(stack.back());
+            stack.pop_back();
+            hash = combine_hash(hash, nodes_[args.back()].hash);
+        }
+        Id id = find_or_add(node.expr, hash, args.data(), node.arity);
+        stack.push_back(id);
+        if (ids)
+            (*ids)[pos] = id;
+    }
+    assert(stack.size() == 1);
+    return stack.back();
+}
+
+void Dag::clear() {
+    nodes_.clear();
+    children_.clear();
+    std::fill(table_.begin(), table_.end(), NoId);
+}
+
+void Dag::eval(
+    const Dataset& dataset,
+    std::size_t begin,
+    std::size_t len,
+    std::vector<double>& buffer,
+    std::vector<const double*>& columns) const
+{
+    assert(begin + len <= dataset.case_num());
+    buffer.resize(nodes_.size() * len);
+    columns.resize(nodes_.size());
+    std::vector<const double*> args;
+    Params params;
+    // children have lower ids
+    for (Id id = 0; id < nodes_.size(); ++id) {
+        const Node& node = nodes_[id];
+        assert(node.expr);
+        if (node.expr->is_term()) {
+            assert(dynamic_cast<const Term*>(node.expr));
+            const Term* term = static_cast<const Term*>(node.expr);
+            columns[id] = dataset.column(term->id()) + begin;
+            continue;
+        }
+        assert(dynamic_cast<const Func*>(node.expr));
+        const Func* func = static_cast<const Func*>(node.expr);
+        args.resize(node.arity);
+        for (unsigned i = 0; i < node.arity; ++i)
+            args[i] = columns[children_[node.children + i]];
+        double* result = buffer.data() + id * len;
+        func->eval_batch(result, args.data(), len, params);
+        columns[id] = result;
+    }
+}
+
+Dag::Id Dag::find_or_add(
+    const Expr* expr,
+    std::uint64_t hash,
+    const Id* children,
+    unsigned arity)
+{
+    std::size_t mask = table_.size() - 1;
+    std::size_t slot = hash & mask;
+    for (; table_[slot] != NoId; slot = (slot + 1) & mask) {
+        const Node& node = nodes_[table_[slot]];
+        if (node.hash == hash
+            && node.expr == expr
+            && node.arity == arity
+            && std::equal(
+                children, children + arity,
+                children_.data() + node.children))
+        {
+            return table_[slot];
+        }
+    }
+
+    // add new node
+    Id id = nodes_.size();
+    Node node;
+    node.expr = expr;
+    node.hash = hash;
+    node.children = children_.size();
+    node.arity = arity;
+    nodes_.push_back(node);
+    children_.insert(children_.end(), children, children + arity);
+    table_[slot] = id;
+
+    // keep load factor below 1/2
+    if (nodes_.size() * 2 > table_.size())
+        grow_table();
+    return id;
+}
+
+void Dag::grow_table() {
+    table_.assign(table_.size() * 2, NoId);
+    std::size_t mask = table_.size() - 1;
+    for (Id id = 0; id < nodes_.size(); ++id) {
+        std::size_t slot = nodes_[id].hash & mask;
+        while (table_[slot] != NoId)
+            slot = (slot + 1) & mask;
+        table_[slot] = id;
+    }
+}
@@ -0,0 +1,301 @@
+#include "dataset.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#ifdef __unix__
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+const char Magic[8] = {'G', 'P', 'D', 'A', 'T', 'A', 0, 0};
+const std::uint32_t Version = 1;
+const std::uint32_t ByteOrder = 0x01020304;
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order; // ByteOrder in native order
+    std::uint64_t case_num;
+    std::uint64_t column_num; // number of terminal columns
+    char reserved[32];
+};
+
+static_assert(sizeof(FileHeader) == 64, "Invalid dataset file header size");
+
+FileHeader make_header(std::size_t case_num, std::size_t column_num) {
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byte_order = ByteOrder;
+    header.case_num = case_num;
+    header.column_num = column_num;
+    return header;
+}
+
+// returns number of values following the header
+std::uint64_t check_header(
+    const FileHeader& header,
+    std::uint64_t file_size,
+    const std::string& path)
+{
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+        throw std::runtime_error("Not a dataset file: " + path);
+    if (header.version != Version)
+        throw std::runtime_error("Unsupported dataset file version: " + path);
+    if (header.byte_order != ByteOrder)
+        throw std::runtime_error("Dataset file byte order mismatch: " + path);
+    // column number + 1 must not wrap
+    if (header.column_num >= UINT64_MAX / sizeof(double))
+        throw std::runtime_error("Invalid dataset file header: " + path);
+    std::uint64_t value_num = (header.column_num + 1) * header.case_num;
+    if (header.case_num > 0
+        && value_num / header.case_num != header.column_num + 1)
+    {
+        throw std::runtime_error("Invalid dataset file header: " + path);
+    }
+    if ((file_size - sizeof(FileHeader)) / sizeof(double) < value_num)
+        throw std::runtime_error("Dataset file is truncated: " + path);
+    return value_num;
+}
+
+std::string error_string(const std::string& message, const std::string& path) {
+    return message + " " + path + ": " + std::strerror(errno);
+}
+
+} // namespace
+
+// Read-only file mapping, values are read into memory
+// if mapping is not supported
+class Dataset::Mapping {
+public:
+    explicit Mapping(const std::string& path);
+
+    Mapping(const Mapping&) = delete;
+
+    Mapping& operator=(const Mapping&) = delete;
+
+    ~Mapping();
+
+    const FileHeader& header() const {
+        return header_;
+    }
+
+    const double* values() const {
+        return values_;
+    }
+
+private:
+    FileHeader header_;
+    void* addr_;
+    std::size_t size_;
+    std::vector<double> data_; // values if not mapped
+    const double* values_;
+};
+
+#ifdef __unix__
+
+Dataset::Mapping::Mapping(const std::string& path)
+    : addr_(MAP_FAILED),
+      size_(0),
+      values_(nullptr)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(error_string("Cannot open", path));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::string error = error_string("Cannot stat", path);
+        close(fd);
+        throw std::runtime_error(error);
+    }
+    size_ = st.st_size;
+    if (size_ < sizeof(FileHeader)) {
+        close(fd);
+        throw std::runtime_error("Not a dataset file: " + path);
+    }
+    addr_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    std::string error = error_string("Cannot map", path);
+    close(fd); // mapping stays valid
+    if (addr_ == MAP_FAILED)
+        throw std::runtime_error(error);
+
+    std::memcpy(&header_, addr_, sizeof(FileHeader));
+    try {
+        check_header(header_, size_, path);
+    } catch (...) {
+        munmap(addr_, size_);
+        throw;
+    }
+    values_ = reinterpret_cast<const double*>(
+        static_cast<const char*>(addr_) + sizeof(FileHeader));
+}
+
+Dataset::Mapping::~Mapping() {
+    if (addr_ != MAP_FAILED)
+        munmap(addr_, size_);
+}
+
+#else // __unix__
+
+Dataset::Mapping::Mapping(const std::string& path)
+    : addr_(nullptr),
+      size_(0),
+      values_(nullptr)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw std::runtime_error("Cannot open " + path);
+    size_ = file.tellg();
+    if (size_ < sizeof(FileHeader))
+        throw std::runtime_error("Not a dataset file: " + path);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&header_), sizeof(FileHeader));
+    data_.resize(check_header(header_, size_, path));
+    file.read(
+        reinterpret_cast<char*>(data_.data()),
+        data_.size() * sizeof(double));
+    if (!file)
+        throw std::runtime_error("Cannot read " + path);
+    values_ = data_.data();
+}
+
+Dataset::Mapping::~Mapping() {}
+
+#endif // __unix__
+
+void Dataset::assign(const FitnessCaseList& fitness_cases) {
+    mapping_.reset();
+    case_num_ = fitness_cases.size();
+    column_num_ = fitness_cases.empty()
+        ? 0
+        : fitness_cases[0].first.size();
+
+    data_.resize((column_num_ + 1) * case_num_);
+    for (std::size_t i = 0; i < case_num_; ++i) {
+        const FitnessCase& fc = fitness_cases[i];
+        if (fc.first.size() != column_num_)
+            throw std::invalid_argument(
+                "Fitness cases have different number of parameters");
+        for (std::size_t k = 0; k < column_num_; ++k)
+            data_[k * case_num_ + i] = fc.first[k];
+        data_[column_num_ * case_num_ + i] = fc.second;
+    }
+}
+
+void Dataset::assign(
+    const Dataset& dataset,
+    const std::vector<std::size_t>& rows)
+{
+    assert(&dataset != this);
+    mapping_.reset();
+    case_num_ = rows.size();
+    column_num_ = dataset.column_num();
+
+    data_.resize((column_num_ + 1) * case_num_);
+    for (std::size_t k = 0; k <= column_num_; ++k) {
+        const double* src = (k < column_num_)
+            ? dataset.column(k)
+            : dataset.target();
+        double* dst = data_.data() + k * case_num_;
+        for (std::size_t i = 0; i < case_num_; ++i) {
+            assert(rows[i] < dataset.case_num());
+            dst[i] = src[rows[i]];
+        }
+    }
+}
+
+void Dataset::map(const std::string& path) {
+    auto mapping = std::make_shared<const Mapping>(path);
+    case_num_ = mapping->header().case_num;
+    column_num_ = mapping->header().column_num;
+    data_.clear();
+    data_.shrink_to_fit();
+    mapping_ = mapping;
+}
+
+void Dataset::write(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("Cannot open " + path);
+    FileHeader header = make_header(case_num_, column_num_);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(
+        reinterpret_cast<const char*>(values()),
+        (column_num_ + 1) * case_num_ * sizeof(double));
+    if (!file.flush())
+        throw std::runtime_error("Cannot write " + path);
+}
+
+void Dataset::params(std::size_t index, Params& params) const {
+    assert(index < case_num_);
+    params.resize(column_num_);
+    for (std::size_t k = 0; k < column_num_; ++k)
+        params[k] = column(k)[index];
+}
+
+const double* Dataset::values() const {
+    return mapping_ ? mapping_->values() : data_.data();
+}
+
+
+DatasetWriter::DatasetWriter(
+    const std::string& path,
+    std::size_t case_num,
+    std::size_t column_num)
+    : file_(path, std::ios::binary | std::ios::trunc),
+      case_num_(case_num),
+      column_num_(column_num),
+      added_num_(0),
+      flushed_num_(0),
+      buffers_(column_num + 1)
+{
+    if (!file_)
+        throw std::runtime_error("Cannot open " + path);
+    FileHeader header = make_header(case_num_, column_num_);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto& buffer : buffers_)
+        buffer.reserve(4096);
+}
+
+void DatasetWriter::add(const double* params, double target) {
+    if (added_num_ == case_num_)
+        throw std::logic_error("Too many fitness cases");
+    for (std::size_t k = 0; k < column_num_; ++k)
+        buffers_[k].push_back(params[k]);
+    buffers_[column_num_].push_back(target);
+    ++added_num_;
+    if (buffers_[0].size() == buffers_[0].capacity())
+        flush();
+}
+
+void DatasetWriter::close() {
+    if (added_num_ != case_num_)
+        throw std::logic_error("Too few fitness cases");
+    flush();
+    file_.close();
+    if (!file_)
+        throw std::runtime_error("Cannot write dataset file");
+}
+
+void DatasetWriter::flush() {
+    // buffered values of each column are written to their position
+    for (std::size_t k = 0; k < buffers_.size(); ++k) {
+        std::vector<double>& buffer = buffers_[k];
+        std::streamoff offset = sizeof(FileHeader)
+            + (k * case_num_ + flushed_num_) * sizeof(double);
+        file_.seekp(offset);
+        file_.write(
+            reinterpret_cast<const char*>(buffer.data()),
+            buffer.size() * sizeof(double));
+        buffer.clear();
+    }
+    flushed_num_ = added_num_;
+    if (!file_)
+        throw std::runtime_error("Cannot write dataset file");
+}
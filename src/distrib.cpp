@@ -0,0 +1,548 @@
+#include "distrib.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#ifdef __unix__
+# include <fcntl.h>
+# include <netdb.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <sys/types.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+
+// Message types
+enum : std::uint8_t {
+    MsgHello = 1,    // worker: empty
+    MsgStats = 2,    // worker: generation, best, avg, worst, population size
+    MsgMigrants = 3, // population
+    MsgDone = 4,     // worker: solution found flag, harvest
+    MsgStop = 5      // coordinator: empty
+};
+
+// Message: 4-byte payload size, 1-byte type, payload
+static const std::size_t HeaderSize = 5;
+static const std::size_t MaxMessageSize = 1 << 30;
+
+#ifdef __unix__
+
+static std::string error_string(const std::string& message) {
+    return message + ": " + std::strerror(errno);
+}
+
+namespace {
+
+struct Address {
+    bool is_unix;
+    std::string path; // Unix socket path or host
+    std::string port;
+};
+
+Address parse_address(const std::string& address) {
+    Address result;
+    if (address.compare(0, 5, "unix:") == 0) {
+        result.is_unix = true;
+        result.path = address.substr(5);
+        if (result.path.empty()
+            || result.path.size() >= sizeof(sockaddr_un().sun_path))
+        {
+            throw std::invalid_argument("Invalid socket path: " + address);
+        }
+        return result;
+    }
+    std::size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument("Invalid address: " + address);
+    result.is_unix = false;
+    result.path = address.substr(0, colon);
+    result.port = address.substr(colon + 1);
+    return result;
+}
+
+sockaddr_un unix_sockaddr(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+// connected TCP socket for `address', -1 on failure
+int connect_tcp(const Address& address) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* info;
+    if (getaddrinfo(address.path.c_str(), address.port.c_str(), &hints, &info) != 0)
+        return -1;
+    int fd = -1;
+    for (addrinfo* ai = info; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+} // namespace
+
+// Socket with buffered incoming messages
+class Connection {
+public:
+    explicit Connection(int fd)
+        : fd_(fd) {}
+
+    Connection(const Connection&) = delete;
+
+    Connection& operator=(const Connection&) = delete;
+
+    ~Connection() {
+        close(fd_);
+    }
+
+    int fd() const {
+        return fd_;
+    }
+
+    // returns false on failure
+    bool send(std::uint8_t type, const std::string& data) {
+        std::string message;
+        WireWriter writer(message);
+        writer.put_u32(data.size());
+        writer.put_u8(type);
+        message += data;
+        const char* pos = message.data();
+        std::size_t size = message.size();
+        while (size > 0) {
+            ssize_t sent = ::send(fd_, pos, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+            pos += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    // read data available without waiting,
+    // returns false if connection is closed
+    bool read_available() {
+        char buffer[65536];
+        while (true) {
+            ssize_t size = recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (size > 0) {
+                buffer_.append(buffer, size);
+                continue;
+            }
+            if (size < 0 && errno == EINTR)
+                continue;
+            return size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    // take next complete message, throws std::runtime_error
+    // if message is too large
+    bool next(std::uint8_t& type, std::string& data) {
+        if (buffer_.size() < HeaderSize)
+            return false;
+        WireReader reader(buffer_.data(), HeaderSize);
+        std::size_t size = reader.get_u32();
+        type = reader.get_u8();
+        if (size > MaxMessageSize)
+            throw std::runtime_error("Message is too large");
+        if (buffer_.size() < HeaderSize + size)
+            return false;
+        data.assign(buffer_, HeaderSize, size);
+        buffer_.erase(0, HeaderSize + size);
+        return true;
+    }
+
+private:
+    int fd_;
+    std::string buffer_;
+};
+
+std::string share_dataset(const Dataset& dataset, const std::string& name) {
+    std::string dir = (access("/dev/shm", W_OK) == 0) ? "/dev/shm" : "/tmp";
+    std::string path = dir + "/" + name;
+    dataset.write(path);
+    return path;
+}
+
+
+struct Coordinator::Peer {
+    std::unique_ptr<Connection> connection;
+    bool open;
+    bool done;
+};
+
+Coordinator::Coordinator(
+    const std::string& address,
+    const TermList& term_list,
+    const FuncList& func_list)
+    : listen_fd_(-1),
+      codec_(term_list, func_list),
+      solution_found_(false),
+      lost_worker_num_(0)
+{
+    Address addr = parse_address(address);
+    if (addr.is_unix) {
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+            throw std::runtime_error(error_string("Cannot create socket"));
+        sockaddr_un sa = unix_sockaddr(addr.path);
+        unlink(addr.path.c_str());
+        if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0) {
+            std::string error = error_string("Cannot bind " + address);
+            close(listen_fd_);
+            throw std::runtime_error(error);
+        }
+        unix_path_ = addr.path;
+        address_ = address;
+
+    } else {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* info;
+        const char* host = addr.path.empty() ? nullptr : addr.path.c_str();
+        if (getaddrinfo(host, addr.port.c_str(), &hints, &info) != 0)
+            throw std::runtime_error("Cannot resolve " + address);
+        for (addrinfo* ai = info; ai && listen_fd_ < 0; ai = ai->ai_next) {
+            listen_fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (listen_fd_ < 0)
+                continue;
+            int on = 1;
+            setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(listen_fd_, ai->ai_addr, ai->ai_addrlen) != 0) {
+                close(listen_fd_);
+                listen_fd_ = -1;
+            }
+        }
+        freeaddrinfo(info);
+        if (listen_fd_ < 0)
+            throw std::runtime_error(error_string("Cannot bind " + address));
+
+        // actual port
+        sockaddr_storage sa;
+        socklen_t len = sizeof(sa);
+        char port[NI_MAXSERV];
+        getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&sa), &len);
+        getnameinfo(
+            reinterpret_cast<sockaddr*>(&sa), len,
+            nullptr, 0, port, sizeof(port), NI_NUMERICSERV);
+        address_ = addr.path + ":" + port;
+    }
+
+    if (listen(listen_fd_, SOMAXCONN) != 0) {
+        std::string error = error_string("Cannot listen on " + address);
+        close(listen_fd_);
+        throw std::runtime_error(error);
+    }
+}
+
+Coordinator::~Coordinator() {
+    close(listen_fd_);
+    if (!unix_path_.empty())
+        unlink(unix_path_.c_str());
+}
+
+void Coordinator::run(std::size_t worker_num, int accept_timeout) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline =
+        Clock::now() + std::chrono::milliseconds(accept_timeout);
+
+    while (true) {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - Clock::now()).count();
+        bool accepting = (peers_.size() < worker_num) && remaining > 0;
+        std::vector<pollfd> fds;
+        std::vector<Peer*> fd_peers;
+        if (accepting)
+            fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+        for (auto& peer : peers_) {
+            if (peer->open) {
+                fds.push_back(pollfd{peer->connection->fd(), POLLIN, 0});
+                fd_peers.push_back(peer.get());
+            }
+        }
+        if (!accepting && fd_peers.empty())
+            break;
+
+        int ready = poll(fds.data(), fds.size(), accepting ? remaining : -1);
+        if (ready < 0 && errno != EINTR)
+            throw std::runtime_error(error_string("Cannot poll"));
+        if (ready <= 0)
+            continue;
+
+        std::size_t first = 0;
+        if (accepting) {
+            first = 1;
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listen_fd_, nullptr, nullptr);
+                if (fd >= 0) {
+                    std::unique_ptr<Peer> peer(new Peer());
+                    peer->connection.reset(new Connection(fd));
+                    peer->open = true;
+                    peer->done = false;
+                    peers_.push_back(std::move(peer));
+                    if (solution_found_)
+                        peers_.back()->connection->send(MsgStop, std::string());
+                }
+            }
+        }
+
+        for (std::size_t i = first; i < fds.size(); ++i) {
+            Peer& peer = *fd_peers[i - first];
+            // peer may be closed by another peer's message
+            if (!fds[i].revents || !peer.open)
+                continue;
+            bool open = peer.connection->read_available();
+            std::uint8_t type;
+            std::string data;
+            try {
+                while (peer.open && peer.connection->next(type, data))
+                    handle(peer, type, data);
+            } catch (const std::runtime_error&) {
+                // invalid data
+                open = false;
+            }
+            if (!open && peer.open)
+                close_peer(peer, !peer.done);
+        }
+
+        // connections are released after the round,
+        // `fds' refer to them
+        for (auto& peer : peers_)
+            if (!peer->open)
+                peer->connection.reset();
+    }
+
+    if (peers_.empty())
+        throw std::runtime_error("No workers connected");
+}
+
+bool Coordinator::handle(Peer& peer, std::uint8_t type, const std::string& data) {
+    WireReader reader(data);
+    switch (type) {
+        case MsgHello:
+            break;
+
+        case MsgStats: {
+            unsigned generation = reader.get_u32();
+            double best = reader.get_double();
+            double avg = reader.get_double();
+            double worst = reader.get_double();
+            std::size_t size = reader.get_u32();
+            // workers report each generation starting from 1,
+            // so a report is at most one generation ahead
+            if (generation == 0 || generation > stats_.size() + 1)
+                throw std::runtime_error("Invalid generation");
+            while (stats_.size() < generation) {
+                GenerationStats empty = {
+                    static_cast<unsigned>(stats_.size() + 1), 0, 0,
+                    std::numeric_limits<double>::infinity(),
+                    0.0,
+                    -std::numeric_limits<double>::infinity()};
+                stats_.push_back(empty);
+            }
+            GenerationStats& stats = stats_[generation - 1];
+            ++stats.worker_num;
+            stats.avg = (stats.avg * stats.population_size + avg * size)
+                / std::max<std::size_t>(1, stats.population_size + size);
+            stats.population_size += size;
+            stats.best = std::min(stats.best, best);
+            stats.worst = std::max(stats.worst, worst);
+            break;
+        }
+
+        case MsgMigrants: {
+            // next live worker
+            std::size_t index = 0;
+            while (peers_[index].get() != &peer)
+                ++index;
+            for (std::size_t i = 1; i < peers_.size(); ++i) {
+                Peer& to = *peers_[(index + i) % peers_.size()];
+                if (to.open && !to.done) {
+                    if (!to.connection->send(MsgMigrants, data))
+                        close_peer(to, true);
+                    break;
+                }
+            }
+            break;
+        }
+
+        case MsgDone: {
+            bool found = reader.get_u8();
+            Population harv = codec_.read_population(reader);
+            for (Indiv& indiv : harv)
+                harvest_.push_back(std::move(indiv));
+            peer.done = true;
+            if (found && !solution_found_) {
+                solution_found_ = true;
+                for (auto& other : peers_)
+                    if (other->open && !other->done)
+                        other->connection->send(MsgStop, std::string());
+            }
+            break;
+        }
+
+        default:
+            throw std::runtime_error("Unknown message type");
+    }
+    return peer.open;
+}
+
+void Coordinator::close_peer(Peer& peer, bool lost) {
+    // connection is released at the end of the round
+    peer.open = false;
+    if (lost)
+        ++lost_worker_num_;
+}
+
+
+Worker::Worker(const std::string& address, Run& run)
+    : run_(run),
+      codec_(run.terminals(), run.functions()),
+      migration_interval_(10),
+      migrant_num_(5),
+      stopped_(false)
+{
+    Address addr = parse_address(address);
+    int fd = -1;
+    if (addr.is_unix) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un sa = unix_sockaddr(addr.path);
+        if (fd >= 0
+            && connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        fd = connect_tcp(addr);
+    }
+    if (fd < 0)
+        throw std::runtime_error(error_string("Cannot connect to " + address));
+    connection_.reset(new Connection(fd));
+}
+
+Worker::~Worker() {}
+
+void Worker::run() {
+    stopped_ = !connection_->send(MsgHello, std::string());
+    while (!stopped_ && !run_.finished()) {
+        run_.next_generation();
+
+        std::string data;
+        WireWriter writer(data);
+        auto best_worst = run_.best_worst_fitness();
+        writer.put_u32(run_.generation());
+        writer.put_double(best_worst.first);
+        writer.put_double(run_.avg_fitness());
+        writer.put_double(best_worst.second);
+        writer.put_u32(run_.population_size());
+        if (!connection_->send(MsgStats, data))
+            break;
+
+        if (migration_interval_ > 0
+            && run_.generation() % migration_interval_ == 0)
+        {
+            data.clear();
+            codec_.write(writer, run_.emigrants(migrant_num_));
+            if (!connection_->send(MsgMigrants, data))
+                break;
+        }
+
+        receive();
+    }
+
+    bool found = run_.solution_found();
+    std::string data;
+    WireWriter writer(data);
+    writer.put_u8(found);
+    codec_.write(writer, found ? run_.harvest() : Population());
+    connection_->send(MsgDone, data);
+}
+
+void Worker::receive() {
+    bool open = connection_->read_available();
+    std::uint8_t type;
+    std::string data;
+    while (connection_->next(type, data)) {
+        if (type == MsgStop) {
+            stopped_ = true;
+        } else if (type == MsgMigrants) {
+            // invalid migrants are dropped, decoding
+            // fails before the run is changed
+            try {
+                WireReader reader(data);
+                run_.immigrate(codec_.read_population(reader));
+            } catch (const std::runtime_error&) {}
+        }
+    }
+    // coordinator is gone
+    if (!open)
+        stopped_ = true;
+}
+
+#else // __unix__
+
+class Connection {};
+
+std::string share_dataset(const Dataset&, const std::string&) {
+    throw std::runtime_error("Not supported on this platform");
+}
+
+struct Coordinator::Peer {};
+
+Coordinator::Coordinator(
+    const std::string&,
+    const TermList& term_list,
+    const FuncList& func_list)
+    : listen_fd_(-1),
+      codec_(term_list, func_list),
+      solution_found_(false),
+      lost_worker_num_(0)
+{
+    throw std::runtime_error("Not supported on this platform");
+}
+
+Coordinator::~Coordinator() {}
+
+void Coordinator::run(std::size_t, int) {}
+
+bool Coordinator::handle(Peer&, std::uint8_t, const std::string&) {
+    return false;
+}
+
+void Coordinator::close_peer(Peer&, bool) {}
+
+Worker::Worker(const std::string&, Run& run)
+    : run_(run),
+      codec_(run.terminals(), run.functions()),
+      migration_interval_(10),
+      migrant_num_(5),
+      stopped_(false)
+{
+    throw std::runtime_error("Not supported on this platform");
+}
+
+Worker::~Worker() {}
+
+void Worker::run() {}
+
+void Worker::receive() {}
+
+#endif // __unix__
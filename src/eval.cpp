@@ -0,0 +1,168 @@
+#include "eval.hpp"
+#include <algorithm>
+#include <cassert>
+#include "dag.hpp"
+
+const std::size_t BatchEval::DefaultBlockSize;
+const int BatchEval::NoBuffer;
+
+void BatchEval::eval(const Tree& tree, const Dataset& dataset, double* out) {
+    assert(tree.valid());
+
+    if (cache_) {
+        subtree_hashes(tree, hashes_);
+        stack_.clear();
+        Column column = eval_subtree(tree, dataset, 0, out);
+        // terminal root
+        if (column.values != out) {
+            std::copy(
+                column.values,
+                column.values + dataset.case_num(),
+                out);
+        }
+        return;
+    }
+
+    eval(tree, dataset, 0, dataset.case_num(), out);
+}
+
+void BatchEval::eval(
+    const Tree& tree,
+    const Dataset& dataset,
+    std::size_t begin,
+    std::size_t end,
+    double* out)
+{
+    assert(tree.valid());
+    assert(end <= dataset.case_num());
+    for (std::size_t i = begin; i < end; i += block_size_) {
+        std::size_t len = std::min(block_size_, end - i);
+        eval_block(tree, dataset, i, len, out + (i - begin));
+    }
+}
+
+void BatchEval::eval_block(
+    const Tree& tree,
+    const Dataset& dataset,
+    std::size_t begin,
+    std::size_t len,
+    double* out)
+{
+    // evaluate in reverse prefix order,
+    // first argument of a function is on top of the stack
+    stack_.clear();
+    for (std::size_t pos = tree.node_num(); pos-- > 0;) {
+        const Tree::Node& node = tree.node(pos);
+        if (node.expr->is_term()) {
+            assert(dynamic_cast<const Term*>(node.expr));
+            const Term* term = static_cast<const Term*>(node.expr);
+            Column column = {dataset.column(term->id()) + begin, NoBuffer};
+            stack_.push_back(column);
+            continue;
+        }
+
+        assert(dynamic_cast<const Func*>(node.expr));
+        const Func* func = static_cast<const Func*>(node.expr);
+        assert(stack_.size() >= node.arity);
+        args_.resize(node.arity);
+        for (unsigned i = 0; i < node.arity; ++i)
+            args_[i] = stack_[stack_.size() - 1 - i].values;
+
+        // root value is written directly to output
+        int buffer = (pos > 0) ? acquire_buffer(len) : NoBuffer;
+        double* result = (pos > 0) ? buffers_[buffer].data() : out;
+        apply(func, node.arity, result, len);
+
+        // release argument buffers
+        for (unsigned i = 0; i < node.arity; ++i) {
+            if (stack_.back().buffer != NoBuffer)
+                free_buffers_.push_back(stack_.back().buffer);
+            stack_.pop_back();
+        }
+        Column column = {result, buffer};
+        stack_.push_back(column);
+    }
+    assert(stack_.size() == 1);
+
+    // terminal root
+    if (stack_.back().values != out)
+        std::copy(stack_.back().values, stack_.back().values + len, out);
+}
+
+BatchEval::Column BatchEval::eval_subtree(
+    const Tree& tree,
+    const Dataset& dataset,
+    std::size_t pos,
+    double* out)
+{
+    const Tree::Node& node = tree.node(pos);
+    std::size_t len = dataset.case_num();
+    if (node.expr->is_term()) {
+        const Term* term = static_cast<const Term*>(node.expr);
+        Column column = {dataset.column(term->id()), NoBuffer};
+        return column;
+    }
+
+    int buffer = out ? NoBuffer : acquire_buffer(len);
+    double* result = out ? out : buffers_[buffer].data();
+    Column column = {result, buffer};
+
+    // cached values are copied, so entries can be evicted while
+    // evaluating the rest of the tree
+    bool cacheable = (node.size >= cache_->min_subtree_size());
+    if (cacheable) {
+        const double* values = cache_->find(tree, pos, hashes_[pos], len);
+        if (values) {
+            std::copy(values, values + len, result);
+            return column;
+        }
+    }
+
+    // evaluate children
+    std::size_t base = stack_.size();
+    std::size_t child = pos + 1;
+    for (unsigned i = 0; i < node.arity; ++i) {
+        stack_.push_back(eval_subtree(tree, dataset, child, nullptr));
+        child = tree.subtree_end(child);
+    }
+    args_.resize(node.arity);
+    for (unsigned i = 0; i < node.arity; ++i)
+        args_[i] = stack_[base + i].values;
+
+    const Func* func = static_cast<const Func*>(node.expr);
+    apply(func, node.arity, result, len);
+
+    // release argument buffers
+    for (std::size_t i = base; i < stack_.size(); ++i)
+        if (stack_[i].buffer != NoBuffer)
+            free_buffers_.push_back(stack_[i].buffer);
+    stack_.resize(base);
+
+    if (cacheable)
+        cache_->insert(tree, pos, hashes_[pos], result, len);
+    return column;
+}
+
+void BatchEval::apply(
+    const Func* func,
+    unsigned arity,
+    double* result,
+    std::size_t len)
+{
+    assert(args_.size() == arity);
+    func->eval_batch(result, args_.data(), len, params_);
+}
+
+int BatchEval::acquire_buffer(std::size_t len) {
+    int buffer;
+    if (free_buffers_.empty()) {
+        buffers_.emplace_back();
+        buffer = buffers_.size() - 1;
+    } else {
+        buffer = free_buffers_.back();
+        free_buffers_.pop_back();
+    }
+    if (buffers_[buffer].size() < len)
+        buffers_[buffer].resize(len);
+    return buffer;
+}
@@ -1,3 +1,21 @@
 #include "expr.hpp"
 
 Expr::~Expr() {}
+
+void Func::eval_batch(
+    double* out,
+    const double* const* args,
+    std::size_t n,
+    Params& params) const
+{
+    if (batch_func_) {
+        batch_func_(out, args, n);
+        return;
+    }
+    params.resize(arity_);
+    for (std::size_t k = 0; k < n; ++k) {
+        for (int i = 0; i < arity_; ++i)
+            params[i] = args[i][k];
+        out[k] = eval(params);
+    }
+}
@@ -1,4 +1,37 @@
 #include "func.hpp"
+#include <cmath>
+#if defined(__AVX__) || defined(__SSE2__)
+# include <immintrin.h>
+#endif
+
+// Vector operations for batch functions
+#if defined(__AVX__)
+typedef __m256d VecD;
+static const std::size_t VecSize = 4;
+# define vec_load _mm256_loadu_pd
+# define vec_store _mm256_storeu_pd
+# define vec_add _mm256_add_pd
+# define vec_sub _mm256_sub_pd
+# define vec_mul _mm256_mul_pd
+# define vec_div _mm256_div_pd
+# define vec_zero _mm256_setzero_pd
+# define vec_andnot _mm256_andnot_pd
+# define vec_cmpeq(a, b) _mm256_cmp_pd(a, b, _CMP_EQ_OQ)
+# define HAS_VEC
+#elif defined(__SSE2__)
+typedef __m128d VecD;
+static const std::size_t VecSize = 2;
+# define vec_load _mm_loadu_pd
+# define vec_store _mm_storeu_pd
+# define vec_add _mm_add_pd
+# define vec_sub _mm_sub_pd
+# define vec_mul _mm_mul_pd
+# define vec_div _mm_div_pd
+# define vec_zero _mm_setzero_pd
+# define vec_andnot _mm_andnot_pd
+# define vec_cmpeq _mm_cmpeq_pd
+# define HAS_VEC
+#endif
 
 double plus2(const Params& args) {
     assert(args.size() == 2);
@@ -46,3 +79,144 @@ double exp1(const Params& args) {
     assert(args.size() == 1);
     return std::exp(args[0]);
 }
+
+// Batch versions
+
+void plus2_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    const double* b = args[1];
+    std::size_t i = 0;
+#ifdef HAS_VEC
+    for (; i + VecSize <= n; i += VecSize)
+        vec_store(out + i, vec_add(vec_load(a + i), vec_load(b + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = a[i] + b[i];
+}
+
+void minus2_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    const double* b = args[1];
+    std::size_t i = 0;
+#ifdef HAS_VEC
+    for (; i + VecSize <= n; i += VecSize)
+        vec_store(out + i, vec_sub(vec_load(a + i), vec_load(b + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = a[i] - b[i];
+}
+
+void mult2_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    const double* b = args[1];
+    std::size_t i = 0;
+#ifdef HAS_VEC
+    for (; i + VecSize <= n; i += VecSize)
+        vec_store(out + i, vec_mul(vec_load(a + i), vec_load(b + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = a[i] * b[i];
+}
+
+void mult3_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    const double* b = args[1];
+    const double* c = args[2];
+    std::size_t i = 0;
+#ifdef HAS_VEC
+    for (; i + VecSize <= n; i += VecSize) {
+        VecD ab = vec_mul(vec_load(a + i), vec_load(b + i));
+        vec_store(out + i, vec_mul(ab, vec_load(c + i)));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = a[i] * b[i] * c[i];
+}
+
+void safe_div2_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    const double* b = args[1];
+    std::size_t i = 0;
+#ifdef HAS_VEC
+    for (; i + VecSize <= n; i += VecSize) {
+        VecD vb = vec_load(b + i);
+        // zero where divisor is zero
+        VecD zero_mask = vec_cmpeq(vb, vec_zero());
+        VecD q = vec_div(vec_load(a + i), vb);
+        vec_store(out + i, vec_andnot(zero_mask, q));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = (b[i] == 0.0) ? 0.0 : a[i] / b[i];
+}
+
+void sin1_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = std::sin(a[i]);
+}
+
+void cos1_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = std::cos(a[i]);
+}
+
+void rlog1_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = (a[i] == 0.0) ? 0.0 : std::log(std::fabs(a[i]));
+}
+
+void exp1_batch(double* out, const double* const* args, std::size_t n) {
+    const double* a = args[0];
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = std::exp(a[i]);
+}
+
+namespace {
+
+typedef double (*Function)(const Params&);
+
+struct BuiltinInfo {
+    Function func;
+    BatchFunction batch_func;
+    Builtin builtin;
+};
+
+const BuiltinInfo builtins[] = {
+    {plus2, plus2_batch, BuiltinPlus2},
+    {minus2, minus2_batch, BuiltinMinus2},
+    {mult2, mult2_batch, BuiltinMult2},
+    {mult3, mult3_batch, BuiltinMult3},
+    {safe_div2, safe_div2_batch, BuiltinSafeDiv2},
+    {sin1, sin1_batch, BuiltinSin1},
+    {cos1, cos1_batch, BuiltinCos1},
+    {rlog1, rlog1_batch, BuiltinRlog1},
+    {exp1, exp1_batch, BuiltinExp1}};
+
+const BuiltinInfo* find_builtin_info(
+    const std::function<double(const Params&)>& func)
+{
+    const Function* target = func.target<Function>();
+    if (target) {
+        for (const auto& info : builtins)
+            if (info.func == *target)
+                return &info;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+BatchFunction find_batch_function(
+    const std::function<double(const Params&)>& func)
+{
+    const BuiltinInfo* info = find_builtin_info(func);
+    return info ? info->batch_func : nullptr;
+}
+
+Builtin find_builtin(const std::function<double(const Params&)>& func) {
+    const BuiltinInfo* info = find_builtin_info(func);
+    return info ? info->builtin : BuiltinNone;
+}
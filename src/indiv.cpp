@@ -4,30 +4,92 @@
 #include <cmath>
 #include <random>
 
-double fitness_combine_sum_abs(std::vector<double> diff) {
-    double sum;
-    for (auto d : diff)
-        sum += std::fabs(d);
+// attempts to choose crossover points fitting tree limits
+static const unsigned CrossoverTryNum = 5;
+
+double fitness_combine_sum_abs(const double* diff, std::size_t n) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        sum += std::fabs(diff[i]);
     return sum;
 }
 
-double fitness_combine_sum_squared(std::vector<double> diff) {
-    double sum;
-    for (auto d : diff)
-        sum += d * d;
+double fitness_combine_sum_squared(const double* diff, std::size_t n) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        sum += diff[i] * diff[i];
     return sum;
 }
 
+static double fitness_term_abs(double diff) {
+    return std::fabs(diff);
+}
+
+static double fitness_term_squared(double diff) {
+    return diff * diff;
+}
+
+FitnessTerm find_fitness_term(const FitnessCombine& combine) {
+    typedef double (*Combine)(const double*, std::size_t);
+    const Combine* f = combine.target<Combine>();
+    if (f && *f == fitness_combine_sum_abs)
+        return fitness_term_abs;
+    if (f && *f == fitness_combine_sum_squared)
+        return fitness_term_squared;
+    return nullptr;
+}
+
+static void subtract_targets(const Dataset& dataset, double* values) {
+    const double* target = dataset.target();
+    for (std::size_t i = 0; i < dataset.case_num(); ++i)
+        values[i] -= target[i];
+}
+
+// Evaluate in blocks using `eval_range(begin, end, out)', write
+// deviations to `errors', stop when sum of error terms exceeds `bound'.
+// Returns true if stopped early.
+template<typename EvalRange>
+static bool race(
+    const Dataset& dataset,
+    FitnessTerm term,
+    double bound,
+    EvalRange eval_range,
+    double* errors,
+    double& fitness)
+{
+    const std::size_t BlockSize = 256;
+    const double* target = dataset.target();
+    double sum = 0.0;
+    for (std::size_t begin = 0; begin < dataset.case_num(); begin += BlockSize) {
+        std::size_t end = std::min(begin + BlockSize, dataset.case_num());
+        eval_range(begin, end, errors + begin);
+        for (std::size_t i = begin; i < end; ++i) {
+            errors[i] -= target[i];
+            sum += term(errors[i]);
+        }
+        if (sum > bound && end < dataset.case_num()) {
+            fitness = sum;
+            return true;
+        }
+    }
+    fitness = sum;
+    return false;
+}
+
 Indiv& Indiv::operator=(const Indiv& other) {
     tree_ = other.tree_;
+    program_ = other.program_;
     has_fitness_ = other.has_fitness_;
+    fitness_bounded_ = other.fitness_bounded_;
     fitness_ = other.fitness_;
     return *this;
 }
 
 Indiv& Indiv::operator=(Indiv&& other) {
     tree_ = std::move(other.tree_);
+    program_ = std::move(other.program_);
     has_fitness_ = other.has_fitness_;
+    fitness_bounded_ = other.fitness_bounded_;
     fitness_ = other.fitness_;
     return *this;
 }
@@ -37,40 +99,169 @@ void Indiv::eval(
     const FitnessCombine& combine)
 {
     std::vector<double> diff(fitness_cases.size()); // deviations
-    for (const auto& fc : fitness_cases)
-        diff.push_back(tree_.get_value(fc.first) - fc.second);
-    fitness_ = combine(diff);
-    has_fitness_ = true;
+    for (std::size_t i = 0; i < fitness_cases.size(); ++i) {
+        const FitnessCase& fc = fitness_cases[i];
+        diff[i] = tree_.get_value(fc.first) - fc.second;
+    }
+    set_fitness(combine(diff.data(), diff.size()));
+}
+
+void Indiv::eval(
+    const Dataset& dataset,
+    BatchEval& evaluator,
+    const FitnessCombine& combine,
+    double* errors,
+    double bound)
+{
+    FitnessTerm term = find_fitness_term(combine);
+    if (term && bound < std::numeric_limits<double>::infinity()) {
+        double fitness;
+        bool bounded = race(
+            dataset, term, bound,
+            [this, &dataset, &evaluator](
+                std::size_t begin, std::size_t end, double* out)
+            {
+                evaluator.eval(tree_, dataset, begin, end, out);
+            },
+            errors, fitness);
+        set_fitness(fitness, bounded);
+        return;
+    }
+
+    evaluator.eval(tree_, dataset, errors);
+    subtract_targets(dataset, errors);
+    set_fitness(combine(errors, dataset.case_num()));
+}
+
+void Indiv::eval(
+    const Dataset& dataset,
+    const FitnessCombine& combine,
+    double* errors,
+    bool native,
+    double bound)
+{
+    const Program& prog = program(native);
+
+    FitnessTerm term = find_fitness_term(combine);
+    if (term && bound < std::numeric_limits<double>::infinity()) {
+        double fitness;
+        bool bounded = race(
+            dataset, term, bound,
+            [&prog, &dataset](
+                std::size_t begin, std::size_t end, double* out)
+            {
+                prog.eval(dataset, begin, end, out);
+            },
+            errors, fitness);
+        set_fitness(fitness, bounded);
+        return;
+    }
+
+    prog.eval(dataset, errors);
+    subtract_targets(dataset, errors);
+    set_fitness(combine(errors, dataset.case_num()));
 }
 
 void Indiv::eval(const FitnessCaseList& fitness_cases) {
     return eval(fitness_cases, fitness_combine_sum_squared);
 }
 
+const Program& Indiv::program(bool native) {
+    if (!program_ || (native && !program_->has_native())) {
+        // shared program is not modified
+        auto program = program_
+            ? std::make_shared<Program>(*program_)
+            : std::make_shared<Program>(tree_);
+        if (native)
+            program->compile_native();
+        program_ = program;
+    }
+    return *program_;
+}
+
+void Indiv::simplify_program() {
+    program_ = std::make_shared<Program>(Simplified(tree_));
+}
+
+void Indiv::simplify_tree() {
+    tree_ = Simplified(tree_).tree();
+    program_.reset();
+}
+
 Indiv crossover(
     const Indiv& p1,
     const Indiv& p2,
     float p_term)
 {
-    // std::cout << "Crossover {" << std::endl;
-    Tree t = p1.tree();
-    t.random_subtree(p_term) =
-        p2.tree().random_subtree(p_term);
-    // std::cout << "  parent 1:" << std::endl;
-    // std::cout << p1.tree().as_pretty_string() << std::endl;
-    // std::cout << "  parent 2:" << std::endl;
-    // std::cout << p2.tree().as_pretty_string() << std::endl;
-    // std::cout << "  child:" << std::endl;
-    // std::cout << t.as_pretty_string() << std::endl;
-    // std::cout << "}" << std::endl;
-    return Indiv(std::move(t));
+    return crossover(p1, p2, Tree::Allocator(), p_term);
+}
+
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    float p_term)
+{
+    return crossover(p1, p2, alloc, default_rng(), p_term);
+}
+
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    Rng& rng,
+    float p_term)
+{
+    const Tree& t1 = p1.tree();
+    const Tree& t2 = p2.tree();
+    std::size_t pos1 = t1.random_subtree(p_term, rng);
+    std::size_t pos2 = t2.random_subtree(p_term, rng);
+    return Indiv(splice(t1, pos1, t2, pos2, alloc));
+}
+
+Indiv crossover(
+    const Indiv& p1,
+    const Indiv& p2,
+    const Tree::Allocator& alloc,
+    Rng& rng,
+    const TreeLimits& limits,
+    float p_term)
+{
+    if (limits.empty())
+        return crossover(p1, p2, alloc, rng, p_term);
+
+    const Tree& t1 = p1.tree();
+    const Tree& t2 = p2.tree();
+    for (unsigned i = 0; i < CrossoverTryNum; ++i) {
+        std::size_t pos1 = t1.random_subtree(p_term, rng);
+        std::size_t pos2 = t2.random_subtree(p_term, rng);
+
+        // check before building offspring
+        std::size_t size =
+            t1.node_num() - t1.node(pos1).size + t2.node(pos2).size;
+        if (limits.max_size > 0 && size > limits.max_size)
+            continue;
+        if (limits.max_depth > 0
+            && t1.node_depth(pos1) + t2.node(pos2).height > limits.max_depth)
+        {
+            continue;
+        }
+
+        Tree tree = splice(t1, pos1, t2, pos2, alloc);
+        // rest of the first parent can be too deep
+        if (limits.max_depth > 0 && tree.depth() > limits.max_depth)
+            continue;
+        return Indiv(std::move(tree));
+    }
+    return Indiv(Tree());
 }
 
 Population make_pop_ramped_hnh(
     const TermList& term_list,
     const FuncList& func_list,
     unsigned depth,
-    std::size_t n)
+    std::size_t n,
+    Rng& rng)
 {
     std::size_t n_full = n / 2;
     // std::size_t n_grow = n - n_full;
@@ -78,11 +269,24 @@ Population make_pop_ramped_hnh(
     Population pop;
     for (std::size_t i = 0; i < n; ++i)
         pop.emplace_back(
-            ((i < n_full) ? full : grow)(term_list, func_list, depth));
+            ((i < n_full) ? full : grow)(term_list, func_list, depth, rng));
     return pop;
 }
 
 const Indiv& tournament(const Population& pop) {
+    return tournament(pop, default_rng());
+}
+
+const Indiv& tournament(const Population& pop, Rng& rng) {
+    return tournament(pop, rng, ParsimonyNone);
+}
+
+const Indiv& tournament(
+    const Population& pop,
+    Rng& rng,
+    ParsimonyMode parsimony,
+    double coefficient)
+{
     // assertion: all population has been evaluated
     assert(
         std::all_of(
@@ -94,10 +298,43 @@ const Indiv& tournament(const Population& pop) {
     assert(pop.size() > 0);
 
     // select 2 contestants at random
-    std::random_device rd;
     std::uniform_int_distribution<std::size_t> distr(0, pop.size() - 1);
-    const Indiv& cont1 = pop[distr(rd)];
-    const Indiv& cont2 = pop[distr(rd)];
+    const Indiv& cont1 = pop[distr(rng)];
+    const Indiv& cont2 = pop[distr(rng)];
     // more fit individual wins
-    return (cont1.fitness() < cont2.fitness()) ? cont1 : cont2;
+    return fitter(cont1, cont2, parsimony, coefficient) ? cont1 : cont2;
+}
+
+bool fitter(const Indiv& a, const Indiv& b) {
+    // NaN is least fit
+    if (std::isnan(b.fitness()))
+        return !std::isnan(a.fitness());
+    // true fitness is not less than a bound,
+    // exact fitness wins if equal to the other's bound
+    if (a.fitness_bounded() != b.fitness_bounded() && b.fitness_bounded())
+        return a.fitness() <= b.fitness();
+    return a.fitness() < b.fitness();
+}
+
+bool fitter(
+    const Indiv& a,
+    const Indiv& b,
+    ParsimonyMode parsimony,
+    double coefficient)
+{
+    if (parsimony == ParsimonyNone
+        || a.fitness_bounded() != b.fitness_bounded()
+        || std::isnan(a.fitness())
+        || std::isnan(b.fitness()))
+    {
+        return fitter(a, b);
+    }
+    if (parsimony == ParsimonyLexicographic) {
+        if (a.fitness() == b.fitness())
+            return a.tree().node_num() < b.tree().node_num();
+        return a.fitness() < b.fitness();
+    }
+    assert(parsimony == ParsimonyCoefficient);
+    return a.fitness() + coefficient * a.tree().node_num()
+        < b.fitness() + coefficient * b.tree().node_num();
 }
@@ -0,0 +1,170 @@
+#include "islands.hpp"
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+Islands::Islands(std::size_t island_num, const Setup& setup)
+    : mailboxes_(island_num),
+      topology_(TopologyRing),
+      migration_interval_(10),
+      migrant_num_(5),
+      seed_(std::random_device()()),
+      solved_(false)
+{
+    if (island_num == 0)
+        throw std::invalid_argument("Island number cannot be zero");
+    for (auto& mailbox : mailboxes_)
+        mailbox = nullptr;
+    for (std::size_t i = 0; i < island_num; ++i) {
+        islands_.emplace_back(new Run());
+        setup(*islands_.back(), i);
+    }
+
+    // expressions at the same position must match
+    for (auto& island : islands_) {
+        std::vector<const Expr*> exprs;
+        for (const auto& term : island->terminals())
+            exprs.push_back(term.get());
+        for (const auto& func : island->functions())
+            exprs.push_back(func.get());
+        if (!island_exprs_.empty()) {
+            const std::vector<const Expr*>& first = island_exprs_[0];
+            bool same = exprs.size() == first.size()
+                && island->terminals().size()
+                    == islands_[0]->terminals().size();
+            for (std::size_t k = 0; same && k < exprs.size(); ++k)
+                same = exprs[k]->name() == first[k]->name()
+                    && exprs[k]->arity() == first[k]->arity();
+            if (!same)
+                throw std::invalid_argument(
+                    "Islands must have the same terminals and functions");
+        }
+        for (std::size_t k = 0; k < exprs.size(); ++k)
+            expr_positions_[exprs[k]] = k;
+        island_exprs_.push_back(std::move(exprs));
+    }
+    set_seed(seed_);
+}
+
+Islands::~Islands() {
+    for (auto& mailbox : mailboxes_)
+        delete mailbox.exchange(nullptr);
+}
+
+void Islands::set_seed(std::uint64_t seed) {
+    seed_ = seed;
+    for (std::size_t i = 0; i < islands_.size(); ++i)
+        islands_[i]->set_seed(make_rng(seed, i)());
+}
+
+void Islands::run() {
+    solved_ = false;
+    std::vector<std::exception_ptr> errors(islands_.size());
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < islands_.size(); ++i) {
+        threads.emplace_back([this, i, &errors]() {
+            try {
+                run_island(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+                solved_ = true; // stop other islands
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+bool Islands::solution_found() {
+    for (auto& island : islands_)
+        if (island->solution_found())
+            return true;
+    return false;
+}
+
+Population Islands::harvest() {
+    Population harv;
+    for (auto& island : islands_) {
+        Population island_harv = island->harvest();
+        for (Indiv& indiv : island_harv)
+            harv.push_back(std::move(indiv));
+    }
+    return harv;
+}
+
+double Islands::avg_fitness() {
+    double sum = 0.0;
+    std::size_t size = 0;
+    for (auto& island : islands_) {
+        sum += island->avg_fitness() * island->population_size();
+        size += island->population_size();
+    }
+    return sum / size;
+}
+
+std::pair<double, double> Islands::best_worst_fitness() {
+    double best = std::numeric_limits<double>::max();
+    double worst = 0.0;
+    for (auto& island : islands_) {
+        auto best_worst = island->best_worst_fitness();
+        best = std::min(best, best_worst.first);
+        worst = std::max(worst, best_worst.second);
+    }
+    return std::make_pair(best, worst);
+}
+
+Population Islands::localize(
+    const Population& migrants,
+    std::size_t index) const
+{
+    const std::vector<const Expr*>& exprs = island_exprs_[index];
+    Population localized;
+    for (const Indiv& migrant : migrants) {
+        Tree::NodeList nodes(migrant.tree().begin(), migrant.tree().end());
+        for (Tree::Node& node : nodes)
+            if (node.expr)
+                node.expr = exprs[expr_positions_.at(node.expr)];
+        localized.emplace_back(Tree(nodes));
+    }
+    return localized;
+}
+
+void Islands::run_island(std::size_t index) {
+    Run& run = *islands_[index];
+    Rng rng = make_rng(seed_, index, 1); // destinations
+    while (!solved_ && !run.finished()) {
+        run.next_generation();
+
+        // collect migrants
+        Population* migrants = mailboxes_[index].exchange(nullptr);
+        if (migrants) {
+            run.immigrate(localize(*migrants, index));
+            delete migrants;
+        }
+
+        // send migrants
+        if (islands_.size() > 1
+            && migration_interval_ > 0
+            && run.generation() % migration_interval_ == 0)
+        {
+            std::size_t to = (index + 1) % islands_.size();
+            if (topology_ == TopologyRandom) {
+                std::uniform_int_distribution<std::size_t> distr(
+                    0, islands_.size() - 2);
+                to = distr(rng);
+                if (to >= index)
+                    ++to;
+            }
+            migrants = new Population(run.emigrants(migrant_num_));
+            delete mailboxes_[to].exchange(migrants);
+        }
+    }
+    if (run.solution_found())
+        solved_ = true;
+}
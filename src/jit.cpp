@@ -0,0 +1,357 @@
+#include "jit.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+#include "program.hpp"
+
+#if defined(__x86_64__) && defined(__unix__)
+# define JIT_SUPPORTED
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+#ifdef JIT_SUPPORTED
+
+namespace {
+
+double call_sin(double x) {
+    return std::sin(x);
+}
+
+double call_cos(double x) {
+    return std::cos(x);
+}
+
+double call_rlog(double x) {
+    return (x == 0.0) ? 0.0 : std::log(std::fabs(x));
+}
+
+double call_exp(double x) {
+    return std::exp(x);
+}
+
+// `top' points past the last argument,
+// first argument is on top of the stack
+double call_func(const Func* func, const double* top) {
+    thread_local Params args;
+    args.resize(func->arity());
+    for (std::size_t i = 0; i < args.size(); ++i)
+        args[i] = top[-1 - static_cast<long>(i)];
+    return func->eval(args);
+}
+
+// x86-64 code emitter.
+// Registers: rbx - columns, r13 - case number, r14 - output,
+// rbp - value stack, r12 - current case.
+// All are callee-saved, so functions can be called without saving them.
+class Emitter {
+public:
+    typedef std::vector<std::uint8_t> Buffer;
+
+    const Buffer& buffer() const {
+        return buf_;
+    }
+
+    std::size_t pos() const {
+        return buf_.size();
+    }
+
+    void prologue() {
+        // push rbx, rbp, r12, r13, r14: stack is 16-byte aligned for calls
+        bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56});
+        bytes({0x48, 0x89, 0xfb}); // mov rbx, rdi
+        bytes({0x49, 0x89, 0xf5}); // mov r13, rsi
+        bytes({0x49, 0x89, 0xd6}); // mov r14, rdx
+        bytes({0x48, 0x89, 0xcd}); // mov rbp, rcx
+        bytes({0x45, 0x31, 0xe4}); // xor r12d, r12d
+    }
+
+    void epilogue() {
+        // pop r14, r13, r12, rbp, rbx; ret
+        bytes({0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3});
+    }
+
+    // jump to end if case number is zero, returns position to patch
+    std::size_t jump_if_no_cases() {
+        bytes({0x4d, 0x85, 0xed}); // test r13, r13
+        bytes({0x0f, 0x84}); // jz rel32
+        std::size_t patch = pos();
+        imm32(0);
+        return patch;
+    }
+
+    void patch_jump(std::size_t patch, std::size_t target) {
+        std::int32_t rel = target - (patch + 4);
+        std::memcpy(&buf_[patch], &rel, 4);
+    }
+
+    // next case, jump to `loop' if not done
+    void loop_next(std::size_t loop) {
+        bytes({0x49, 0xff, 0xc4}); // inc r12
+        bytes({0x4d, 0x39, 0xec}); // cmp r12, r13
+        bytes({0x0f, 0x82}); // jb rel32
+        imm32(static_cast<long>(loop) - static_cast<long>(pos() + 4));
+    }
+
+    // push value of terminal column to stack slot
+    void load_term(std::size_t column, std::size_t slot) {
+        bytes({0x48, 0x8b, 0x83}); // mov rax, [rbx + disp32]
+        imm32(column * 8);
+        bytes({0xf2, 0x42, 0x0f, 0x10, 0x04, 0xe0}); // movsd xmm0, [rax + r12*8]
+        store(slot, 0);
+    }
+
+    // store constant to stack slot
+    void load_const(double value, std::size_t slot) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bytes({0x48, 0xb8}); // mov rax, imm64
+        imm64(bits);
+        bytes({0x48, 0x89, 0x85}); // mov [rbp + disp32], rax
+        imm32(slot * 8);
+    }
+
+    // write stack slot to output
+    void store_output(std::size_t slot) {
+        load(0, slot);
+        bytes({0xf2, 0x43, 0x0f, 0x11, 0x04, 0xe6}); // movsd [r14 + r12*8], xmm0
+    }
+
+    // movsd xmm, [rbp + slot * 8]
+    void load(unsigned xmm, std::size_t slot) {
+        sd_op(0x10, xmm, slot);
+    }
+
+    // movsd [rbp + slot * 8], xmm
+    void store(std::size_t slot, unsigned xmm) {
+        sd_op(0x11, xmm, slot);
+    }
+
+    // xmm0 = xmm0 op [rbp + slot * 8]
+    void add(std::size_t slot) {
+        sd_op(0x58, 0, slot);
+    }
+
+    void sub(std::size_t slot) {
+        sd_op(0x5c, 0, slot);
+    }
+
+    void mul(std::size_t slot) {
+        sd_op(0x59, 0, slot);
+    }
+
+    // xmm0 = (xmm1 == 0) ? 0 : xmm0 / xmm1
+    void safe_div() {
+        bytes({0x66, 0x0f, 0x57, 0xd2}); // xorpd xmm2, xmm2
+        bytes({0x66, 0x0f, 0x2e, 0xca}); // ucomisd xmm1, xmm2
+        bytes({0x7a, 0x08}); // jp div (unordered)
+        bytes({0x75, 0x06}); // jne div
+        bytes({0x66, 0x0f, 0x57, 0xc0}); // xorpd xmm0, xmm0
+        bytes({0xeb, 0x04}); // jmp end
+        bytes({0xf2, 0x0f, 0x5e, 0xc1}); // div: divsd xmm0, xmm1
+    }
+
+    // xmm0 = f(xmm0)
+    void call_unary(double (*f)(double)) {
+        call(reinterpret_cast<std::uint64_t>(f));
+    }
+
+    // xmm0 = call_func(func, rbp + top * 8)
+    void call_generic(const Func* func, std::size_t top) {
+        bytes({0x48, 0xbf}); // mov rdi, imm64
+        imm64(reinterpret_cast<std::uint64_t>(func));
+        bytes({0x48, 0x8d, 0xb5}); // lea rsi, [rbp + disp32]
+        imm32(top * 8);
+        call(reinterpret_cast<std::uint64_t>(&call_func));
+    }
+
+    // xmm0 = f(rbp + top * 8)
+    void call_stack(StackFunction f, std::size_t top) {
+        bytes({0x48, 0x8d, 0xbd}); // lea rdi, [rbp + disp32]
+        imm32(top * 8);
+        call(reinterpret_cast<std::uint64_t>(f));
+    }
+
+private:
+    void call(std::uint64_t address) {
+        bytes({0x48, 0xb8}); // mov rax, imm64
+        imm64(address);
+        bytes({0xff, 0xd0}); // call rax
+    }
+
+    // scalar double SSE2 operation with [rbp + disp32] operand
+    void sd_op(std::uint8_t opcode, unsigned xmm, std::size_t slot) {
+        bytes({0xf2, 0x0f, opcode, static_cast<std::uint8_t>(0x85 | (xmm << 3))});
+        imm32(slot * 8);
+    }
+
+    void bytes(std::initializer_list<std::uint8_t> list) {
+        buf_.insert(buf_.end(), list);
+    }
+
+    void imm32(std::int32_t value) {
+        std::uint8_t data[4];
+        std::memcpy(data, &value, 4);
+        buf_.insert(buf_.end(), data, data + 4);
+    }
+
+    void imm64(std::uint64_t value) {
+        std::uint8_t data[8];
+        std::memcpy(data, &value, 8);
+        buf_.insert(buf_.end(), data, data + 8);
+    }
+
+    Buffer buf_;
+};
+
+void emit(Emitter& e, const Program& program) {
+    std::size_t depth = 0; // number of values on the stack
+    for (const Program::Instr& instr : program.code()) {
+        switch (instr.op) {
+            case Program::OpTerm:
+                e.load_term(instr.arg, depth);
+                break;
+            case Program::OpConst:
+                e.load_const(program.consts()[instr.arg], depth);
+                break;
+            case Program::OpCall:
+                e.call_generic(program.funcs()[instr.arg], depth);
+                e.store(depth - instr.arity, 0);
+                break;
+            case Program::OpCallStack:
+                e.call_stack(program.funcs()[instr.arg]->stack_func(), depth);
+                e.store(depth - instr.arity, 0);
+                break;
+            case Program::OpPlus2:
+                e.load(0, depth - 1);
+                e.add(depth - 2);
+                e.store(depth - 2, 0);
+                break;
+            case Program::OpMinus2:
+                e.load(0, depth - 1);
+                e.sub(depth - 2);
+                e.store(depth - 2, 0);
+                break;
+            case Program::OpMult2:
+                e.load(0, depth - 1);
+                e.mul(depth - 2);
+                e.store(depth - 2, 0);
+                break;
+            case Program::OpMult3:
+                e.load(0, depth - 1);
+                e.mul(depth - 2);
+                e.mul(depth - 3);
+                e.store(depth - 3, 0);
+                break;
+            case Program::OpSafeDiv2:
+                e.load(0, depth - 1);
+                e.load(1, depth - 2);
+                e.safe_div();
+                e.store(depth - 2, 0);
+                break;
+            case Program::OpSin1:
+            case Program::OpCos1:
+            case Program::OpRlog1:
+            case Program::OpExp1:
+                e.load(0, depth - 1);
+                e.call_unary(
+                    (instr.op == Program::OpSin1) ? call_sin
+                    : (instr.op == Program::OpCos1) ? call_cos
+                    : (instr.op == Program::OpRlog1) ? call_rlog
+                    : call_exp);
+                e.store(depth - 1, 0);
+                break;
+            default:
+                throw std::runtime_error("Unknown program instruction");
+        }
+        depth = depth + 1 - instr.arity;
+    }
+}
+
+} // namespace
+
+bool NativeCode::supported() {
+    return true;
+}
+
+NativeCode::NativeCode(const Program& program)
+    : code_(nullptr),
+      size_(0),
+      mapped_size_(0),
+      stack_size_(program.stack_size())
+{
+    Emitter e;
+    e.prologue();
+    std::size_t patch = e.jump_if_no_cases();
+    std::size_t loop = e.pos();
+    emit(e, program);
+    e.store_output(0);
+    e.loop_next(loop);
+    e.patch_jump(patch, e.pos());
+    e.epilogue();
+
+    // copy to executable memory
+    size_ = e.buffer().size();
+    std::size_t page_size = sysconf(_SC_PAGESIZE);
+    mapped_size_ = (size_ + page_size - 1) / page_size * page_size;
+    void* mem = mmap(
+        nullptr, mapped_size_,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("Cannot allocate memory for native code");
+    std::memcpy(mem, e.buffer().data(), size_);
+    if (mprotect(mem, mapped_size_, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, mapped_size_);
+        throw std::runtime_error("Cannot make native code executable");
+    }
+    code_ = mem;
+}
+
+NativeCode::~NativeCode() {
+    if (code_)
+        munmap(code_, mapped_size_);
+}
+
+void NativeCode::eval(
+    const Dataset& dataset,
+    std::size_t begin,
+    std::size_t end,
+    double* out) const
+{
+    std::vector<double> stack(stack_size_);
+    std::vector<const double*> columns(dataset.column_num());
+    for (std::size_t k = 0; k < columns.size(); ++k)
+        columns[k] = dataset.column(k) + begin;
+    Function f = reinterpret_cast<Function>(code_);
+    f(columns.data(), end - begin, out, stack.data());
+}
+
+#else // JIT_SUPPORTED
+
+bool NativeCode::supported() {
+    return false;
+}
+
+NativeCode::NativeCode(const Program&)
+    : code_(nullptr),
+      size_(0),
+      mapped_size_(0),
+      stack_size_(0)
+{
+    throw std::runtime_error("Native code is not supported on this platform");
+}
+
+NativeCode::~NativeCode() {}
+
+void NativeCode::eval(
+    const Dataset&,
+    std::size_t,
+    std::size_t,
+    double*) const {}
+
+#endif // JIT_SUPPORTED
@@ -1,14 +1,23 @@
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
+#include "checkpoint.hpp"
 #include "expr.hpp"
 #include "indiv.hpp"
 #include "func.hpp"
 #include "run.hpp"
+#include "simplify.hpp"
 
 double square1(const Params& args) {
     return args[0] * args[0];
@@ -19,12 +28,25 @@ const unsigned GenerationNumber = 50;
 const float CrossoverRate = 0.9;
 const double FitnessGoal = 0.01;
 const unsigned InitialDepth = 3;
+const unsigned MaxDepth = 17;
+const bool UseArena = true;
+const std::size_t FitnessCacheCapacity = 16 << 20;
+const unsigned CheckpointInterval = 10;
 
-int main() {
+int usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " [--seed N] [--checkpoint file] [dataset file]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv) {
     Run run;
     run.set_generation_number(GenerationNumber);
     run.set_crossover_rate(CrossoverRate);
     run.set_fitness_goal(FitnessGoal);
+    run.set_use_arena(UseArena);
+    run.set_tree_limits(TreeLimits(MaxDepth));
+    run.set_fitness_cache(FitnessCacheCapacity);
 
     // set terminals
     run.add_terminal(0, "a");
@@ -38,21 +60,64 @@ int main() {
     run.add_function(rlog1, 1, "rlog");
     run.add_function(exp1, 1, "exp");
 
-    // generage fitness cases
-    std::random_device rand_dev;
-    std::uniform_real_distribution<double> param_distr(-2.0, 2.0);
-    for (std::size_t i = 0; i < 20; ++i) {
-        // generate random parameters
-        Params p;
-        for (std::size_t k = 0; k < run.terminal_num(); ++k)
-            p.push_back(param_distr(rand_dev));
-        // a^4 + a^3  + a^2 + a
-        double target =
-            p[0]*p[0]*p[0]*p[0]
-            + p[0]*p[0]*p[0]
-            + p[0]*p[0]
-            + p[0];
-        run.add_fitness_case(p, target);
+    // arguments: [--seed N] [--checkpoint file] [dataset file],
+    // run is resumed from existing checkpoint file, seed
+    // must be the same to generate the same fitness cases
+    const char* dataset_path = nullptr;
+    const char* checkpoint_path = nullptr;
+    bool has_seed = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = (i + 1 < argc);
+        if (arg == "--seed" && has_value) {
+            const char* value = argv[++i];
+            char* end;
+            errno = 0;
+            unsigned long long seed = std::strtoull(value, &end, 10);
+            if (!std::isdigit(static_cast<unsigned char>(value[0]))
+                || *end != '\0' || errno == ERANGE)
+            {
+                std::cerr << "Invalid seed: " << value << std::endl;
+                return usage(argv[0]);
+            }
+            run.set_seed(seed);
+            has_seed = true;
+        } else if (arg == "--checkpoint" && has_value) {
+            checkpoint_path = argv[++i];
+        } else if (arg.compare(0, 2, "--") == 0 || dataset_path) {
+            // unknown option, missing value or extra argument
+            return usage(argv[0]);
+        } else {
+            dataset_path = argv[i];
+        }
+    }
+    if (checkpoint_path && !dataset_path && !has_seed) {
+        std::cerr << "--checkpoint requires --seed"
+                  << " if fitness cases are generated" << std::endl;
+        return 1;
+    }
+    // run is replayed with the same seed
+    std::cout << "Seed: " << run.seed() << std::endl;
+
+    if (dataset_path) {
+        // load fitness cases from dataset file, see csv2dataset
+        run.load_dataset(dataset_path);
+    } else {
+        // generage fitness cases
+        std::uniform_real_distribution<double> param_distr(-2.0, 2.0);
+        for (std::size_t i = 0; i < 20; ++i) {
+            // generate random parameters
+            Params p;
+            for (std::size_t k = 0; k < run.terminal_num(); ++k)
+                p.push_back(param_distr(run.rng()));
+            // a^4 + a^3  + a^2 + a
+            double target =
+                p[0]*p[0]*p[0]*p[0]
+                + p[0]*p[0]*p[0]
+                + p[0]*p[0]
+                + p[0];
+            run.add_fitness_case(p, target);
+        }
     }
 
     // initial population
@@ -60,23 +125,50 @@ int main() {
         make_pop_ramped_hnh(
             run.terminals(), run.functions(),
             InitialDepth,
-            PopulationSize));
+            PopulationSize,
+            run.rng()));
+
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (checkpoint_path) {
+        if (std::ifstream(checkpoint_path)) {
+            try {
+                run.load_checkpoint(checkpoint_path);
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            std::cout << "Resumed at generation " << run.generation()
+                      << std::endl;
+        }
+        checkpointer.reset(
+            new Checkpointer(run, checkpoint_path, CheckpointInterval));
+    }
 
     // run
-    do {
+    while (!run.finished()) {
         std::cout << "[Generation " << run.generation() << "]" << std::endl;
         std::cout << "Avg.  fitness: " << run.avg_fitness() << std::endl;
         auto best_worst = run.best_worst_fitness();
         std::cout << "Best  fitness: " << best_worst.first << std::endl;
         std::cout << "Worst fitness: " << best_worst.second << std::endl;
+        const Run::EvalStats& eval_stats = run.eval_stats();
+        std::cout << "New: " << eval_stats.new_num
+                  << ", cache hits: " << eval_stats.cache_hits
+                  << ", duplicates: " << eval_stats.duplicates << std::endl;
         run.next_generation();
-    } while (!run.finished());
+        if (checkpointer)
+            checkpointer->update();
+    }
+    if (checkpointer)
+        checkpointer->wait();
 
     if (run.solution_found()) {
         std::cout << "HARVEST:" << std::endl;
         std::cout << std::endl;
         for (const Indiv& indiv : run.harvest()) {
             std::cout << indiv.tree().as_pretty_string() << std::endl;
+            std::cout << "Simplified: "
+                      << Simplified(indiv.tree()).as_string() << std::endl;
             std::cout << "Fitness: " << indiv.fitness() << std::endl;
             std::cout << std::endl;
         }
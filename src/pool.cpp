@@ -0,0 +1,127 @@
+#include "pool.hpp"
+#include <algorithm>
+#include <cassert>
+
+ThreadPool::ThreadPool(std::size_t thread_num)
+    : task_(nullptr),
+      round_(0),
+      active_num_(0),
+      stop_(false),
+      failed_(false)
+{
+    if (thread_num == 0)
+        thread_num = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < thread_num; ++i)
+        queues_.emplace_back(new Queue());
+    for (std::size_t i = 1; i < thread_num; ++i)
+        threads_.emplace_back(&ThreadPool::thread_main, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+}
+
+void ThreadPool::run(std::size_t n, std::size_t chunk_size, const Task& task) {
+    assert(chunk_size > 0);
+    if (n == 0)
+        return;
+
+    // distribute contiguous parts of chunks
+    std::size_t chunk_num = (n + chunk_size - 1) / chunk_size;
+    std::size_t worker_num = queues_.size();
+    for (std::size_t w = 0; w < worker_num; ++w) {
+        std::size_t first = chunk_num * w / worker_num;
+        std::size_t last = chunk_num * (w + 1) / worker_num;
+        std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+        for (std::size_t c = first; c < last; ++c)
+            queues_[w]->chunks.emplace_back(
+                c * chunk_size,
+                std::min(n, (c + 1) * chunk_size));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        failed_ = false;
+        error_ = nullptr;
+        active_num_ = threads_.size();
+        ++round_;
+    }
+    start_.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return active_num_ == 0; });
+    task_ = nullptr;
+    if (error_)
+        std::rethrow_exception(error_);
+}
+
+void ThreadPool::thread_main(std::size_t worker) {
+    std::size_t round = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [this, round]() {
+                return stop_ || round_ != round;
+            });
+            if (stop_)
+                return;
+            round = round_;
+        }
+
+        work(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --active_num_;
+        }
+        done_.notify_one();
+    }
+}
+
+void ThreadPool::work(std::size_t worker) {
+    Range range;
+    while (pop(worker, range)) {
+        // remaining chunks are skipped after failure
+        if (failed_)
+            continue;
+        try {
+            (*task_)(range.first, range.second, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+            failed_ = true;
+        }
+    }
+}
+
+bool ThreadPool::pop(std::size_t worker, Range& range) {
+    {
+        Queue& queue = *queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.chunks.empty()) {
+            range = queue.chunks.front();
+            queue.chunks.pop_front();
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+        Queue& queue = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.chunks.empty()) {
+            range = queue.chunks.back();
+            queue.chunks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
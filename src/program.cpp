@@ -0,0 +1,198 @@
+#include "program.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+static Program::Opcode builtin_opcode(Builtin builtin) {
+    switch (builtin) {
+        case BuiltinPlus2: return Program::OpPlus2;
+        case BuiltinMinus2: return Program::OpMinus2;
+        case BuiltinMult2: return Program::OpMult2;
+        case BuiltinMult3: return Program::OpMult3;
+        case BuiltinSafeDiv2: return Program::OpSafeDiv2;
+        case BuiltinSin1: return Program::OpSin1;
+        case BuiltinCos1: return Program::OpCos1;
+        case BuiltinRlog1: return Program::OpRlog1;
+        case BuiltinExp1: return Program::OpExp1;
+        case BuiltinNone: break;
+    }
+    return Program::OpCall;
+}
+
+Program::Program(const Tree& tree)
+    : stack_size_(0)
+{
+    if (!tree.valid())
+        throw std::invalid_argument("Cannot compile invalid tree");
+
+    code_.reserve(tree.node_num());
+    std::size_t depth = 0;
+    for (std::size_t pos = tree.node_num(); pos-- > 0;) {
+        const Tree::Node& node = tree.node(pos);
+        add(node.expr, node.arity, depth);
+    }
+}
+
+Program::Program(const Simplified& simplified)
+    : stack_size_(0)
+{
+    const Simplified::NodeList& nodes = simplified.nodes();
+    code_.reserve(nodes.size());
+    std::size_t depth = 0;
+    for (std::size_t pos = nodes.size(); pos-- > 0;) {
+        if (nodes[pos].expr) {
+            add(nodes[pos].expr, nodes[pos].arity, depth);
+        } else {
+            add_const(nodes[pos].value, depth);
+        }
+    }
+}
+
+void Program::add(const Expr* expr, unsigned arity, std::size_t& depth) {
+    Instr instr;
+    instr.arity = arity;
+    if (expr->is_term()) {
+        assert(dynamic_cast<const Term*>(expr));
+        instr.op = OpTerm;
+        instr.arg = static_cast<const Term*>(expr)->id();
+    } else {
+        assert(dynamic_cast<const Func*>(expr));
+        const Func* func = static_cast<const Func*>(expr);
+        instr.op = builtin_opcode(func->builtin());
+        instr.arg = 0;
+        if (instr.op == OpCall && func->stack_func())
+            instr.op = OpCallStack;
+        if (instr.op == OpCall || instr.op == OpCallStack) {
+            auto it = std::find(funcs_.begin(), funcs_.end(), func);
+            instr.arg = it - funcs_.begin();
+            if (it == funcs_.end())
+                funcs_.push_back(func);
+        }
+    }
+    code_.push_back(instr);
+
+    // arguments are replaced with result
+    depth = depth + 1 - arity;
+    stack_size_ = std::max(stack_size_, depth);
+}
+
+void Program::add_const(double value, std::size_t& depth) {
+    Instr instr;
+    instr.op = OpConst;
+    instr.arity = 0;
+    instr.arg = consts_.size();
+    consts_.push_back(value);
+    code_.push_back(instr);
+    ++depth;
+    stack_size_ = std::max(stack_size_, depth);
+}
+
+double Program::eval(const Params& params) const {
+    // single row, one column per parameter
+    std::vector<const double*> columns(params.size());
+    for (std::size_t k = 0; k < params.size(); ++k)
+        columns[k] = &params[k];
+    std::vector<double> stack(stack_size_);
+    Params args;
+    return run(columns.data(), 0, stack.data(), args);
+}
+
+bool Program::compile_native() {
+    if (!native_ && NativeCode::supported())
+        native_ = std::make_shared<NativeCode>(*this);
+    return has_native();
+}
+
+void Program::eval(const Dataset& dataset, double* out) const {
+    eval(dataset, 0, dataset.case_num(), out);
+}
+
+void Program::eval(
+    const Dataset& dataset,
+    std::size_t begin,
+    std::size_t end,
+    double* out) const
+{
+    assert(begin <= end && end <= dataset.case_num());
+    if (native_) {
+        native_->eval(dataset, begin, end, out);
+        return;
+    }
+
+    std::vector<double> stack(stack_size_);
+    Params args;
+    std::vector<const double*> columns(dataset.column_num());
+    for (std::size_t k = 0; k < columns.size(); ++k)
+        columns[k] = dataset.column(k) + begin;
+    for (std::size_t row = 0; row < end - begin; ++row)
+        out[row] = run(columns.data(), row, stack.data(), args);
+}
+
+double Program::run(
+    const double* const* columns,
+    std::size_t row,
+    double* stack,
+    Params& args) const
+{
+    double* sp = stack; // top of the stack is sp[-1]
+    for (const Instr& instr : code_) {
+        switch (instr.op) {
+            case OpTerm:
+                *sp++ = columns[instr.arg][row];
+                break;
+            case OpConst:
+                *sp++ = consts_[instr.arg];
+                break;
+            case OpCall:
+                args.assign(
+                    std::reverse_iterator<double*>(sp),
+                    std::reverse_iterator<double*>(sp - instr.arity));
+                sp -= instr.arity;
+                *sp++ = funcs_[instr.arg]->eval(args);
+                break;
+            case OpCallStack: {
+                double value = funcs_[instr.arg]->stack_func()(sp);
+                sp -= instr.arity;
+                *sp++ = value;
+                break;
+            }
+            case OpPlus2:
+                sp[-2] = sp[-1] + sp[-2];
+                --sp;
+                break;
+            case OpMinus2:
+                sp[-2] = sp[-1] - sp[-2];
+                --sp;
+                break;
+            case OpMult2:
+                sp[-2] = sp[-1] * sp[-2];
+                --sp;
+                break;
+            case OpMult3:
+                sp[-3] = sp[-1] * sp[-2] * sp[-3];
+                sp -= 2;
+                break;
+            case OpSafeDiv2:
+                sp[-2] = (sp[-2] == 0.0) ? 0.0 : sp[-1] / sp[-2];
+                --sp;
+                break;
+            case OpSin1:
+                sp[-1] = std::sin(sp[-1]);
+                break;
+            case OpCos1:
+                sp[-1] = std::cos(sp[-1]);
+                break;
+            case OpRlog1:
+                sp[-1] = (sp[-1] == 0.0) ? 0.0 : std::log(std::fabs(sp[-1]));
+                break;
+            case OpExp1:
+                sp[-1] = std::exp(sp[-1]);
+                break;
+            default:
+                assert(false);
+        }
+    }
+    assert(sp == stack + 1);
+    return sp[-1];
+}
@@ -0,0 +1,44 @@
+#include "rng.hpp"
+#include <stdexcept>
+
+// splitmix64 step, also used to mix stream numbers into the seed
+static std::uint64_t splitmix64(std::uint64_t& state) {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+void Xoshiro256::seed(std::uint64_t seed) {
+    // splitmix64 is a bijection of its counter,
+    // at most one word can be zero
+    for (auto& s : s_)
+        s = splitmix64(seed);
+}
+
+void Xoshiro256::set_state(const State& state) {
+    if (state == State())
+        throw std::invalid_argument("Engine state cannot be all zeros");
+    s_ = state;
+}
+
+Rng& default_rng() {
+    thread_local Rng rng(
+        (static_cast<std::uint64_t>(std::random_device{}()) << 32)
+        ^ std::random_device{}());
+    return rng;
+}
+
+Rng make_rng(
+    std::uint64_t seed,
+    std::uint64_t stream1,
+    std::uint64_t stream2)
+{
+    // hash of (seed, stream1, stream2)
+    std::uint64_t state = seed;
+    std::uint64_t hash = splitmix64(state);
+    state = hash ^ stream1;
+    hash = splitmix64(state);
+    state = hash ^ stream2;
+    return Rng(splitmix64(state));
+}
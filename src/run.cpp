@@ -1,40 +1,188 @@
 #include "run.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <functional>
 #include <limits>
+#include <numeric>
+#include <unordered_map>
+#include "checkpoint.hpp"
+#include "wire.hpp"
+
+// number of individuals evaluated by a thread at once
+static const std::size_t EvalChunkSize = 4;
+
+// number of fitness cases of unique subtrees evaluated at once,
+// all subtree values of a block are kept
+static const std::size_t SubtreeBlockSize = 64;
+
+// number of offspring bred by a thread at once,
+// each chunk uses its own random stream
+static const std::size_t BreedChunkSize = 16;
+
+// true if trees have the same nodes
+static bool same_tree(const Tree& a, const Tree& b) {
+    return a.node_num() == b.node_num()
+        && std::equal(
+            a.begin(), a.end(), b.begin(),
+            [](const Tree::Node& x, const Tree::Node& y) {
+                return x.expr == y.expr;
+            });
+}
+
+// DSS case weight: difficulty^DssDifficultyExp + age^DssAgeExp
+static const double DssDifficultyExp = 1.0;
+static const double DssAgeExp = 3.5;
+
+// checkpoint data starts with magic and version
+static const char CheckpointMagic[8] = {'G', 'P', 'C', 'K', 'P', 'T', 0, 0};
+static const std::uint32_t CheckpointVersion = 2;
+
+// checksum of dataset values, to detect different fitness cases
+static std::uint64_t dataset_checksum(const Dataset& dataset) {
+    std::uint64_t hash = dataset.case_num() ^ (dataset.column_num() << 32);
+    auto add = [&hash, &dataset](const double* values) {
+        for (std::size_t i = 0; i < dataset.case_num(); ++i) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &values[i], sizeof(bits));
+            hash = (hash ^ bits) * 0x9e3779b97f4a7c15ULL;
+            hash ^= hash >> 29;
+        }
+    };
+    for (std::size_t k = 0; k < dataset.column_num(); ++k)
+        add(dataset.column(k));
+    add(dataset.target());
+    return hash;
+}
+
+static void put_doubles(WireWriter& writer, const std::vector<double>& values) {
+    writer.put_u64(values.size());
+    for (double value : values)
+        writer.put_double(value);
+}
+
+static void put_indices(
+    WireWriter& writer,
+    const std::vector<std::size_t>& values)
+{
+    writer.put_u64(values.size());
+    for (std::size_t value : values)
+        writer.put_u64(value);
+}
+
+static std::vector<double> get_doubles(WireReader& reader) {
+    std::uint64_t size = reader.get_u64();
+    std::vector<double> values;
+    for (std::uint64_t i = 0; i < size; ++i)
+        values.push_back(reader.get_double());
+    return values;
+}
+
+// values must be less than `limit'
+static std::vector<std::size_t> get_indices(
+    WireReader& reader,
+    std::size_t limit)
+{
+    std::uint64_t size = reader.get_u64();
+    std::vector<std::size_t> values;
+    for (std::uint64_t i = 0; i < size; ++i) {
+        std::uint64_t value = reader.get_u64();
+        if (value >= limit)
+            throw std::runtime_error("Invalid checkpoint: case index");
+        values.push_back(value);
+    }
+    return values;
+}
 
 bool Run::finished() {
-    return (generation_ == generation_number_)
+    return (generation_ >= generation_number_)
         || solution_found();
 }
 
 bool Run::solution_found() {
     assert(population_.size() > 0);
     eval_population();
-    return std::any_of(
-        population_.begin(), population_.end(),
-        [this](const Indiv& indiv) {
-            return indiv.fitness() < fitness_goal_;
-        });
+    for (std::size_t i = 0; i < population_.size(); ++i)
+        if (population_[i].fitness() < fitness_goal_
+            && (!sampling() || eval_full(i).fitness() < fitness_goal_))
+        {
+            return true;
+        }
+    return false;
 }
 
 void Run::next_generation() {
     validate();
     eval_population();
+    update_race_bound();
 
-    // crossover
-    population_next_.clear();
-    while (population_next_.size() < population_size_ * crossover_rate_)
-        population_next_.push_back(
-            crossover(tournament(population_), tournament(population_)));
+    // offspring slots: crossover first, then reproduction
+    std::size_t crossover_num = 0;
+    while (crossover_num < population_size_
+           && crossover_num < population_size_ * crossover_rate_)
+    {
+        ++crossover_num;
+    }
+    population_next_.assign(population_size_, Indiv(Tree()));
+    errors_next_.resize(population_size_ * errors_case_num_);
 
-    // reproduction
-    while (population_next_.size() < population_size_)
-        population_next_.push_back(tournament(population_));
+    auto breed = [this, crossover_num](
+        std::size_t begin,
+        std::size_t end,
+        std::size_t worker)
+    {
+        Rng rng = make_rng(seed_, generation_, begin / BreedChunkSize);
+        Arena* arena = arenas_[1 - arena_index_][worker].get();
+        Tree::Allocator alloc(use_arena_ ? arena : nullptr);
+        auto select = [this, &rng]() -> const Indiv& {
+            return tournament(
+                population_, rng, parsimony_, parsimony_coefficient_);
+        };
+        for (std::size_t i = begin; i < end; ++i) {
+            const Indiv* parent;
+            if (i < crossover_num) {
+                const Indiv& p1 = select();
+                const Indiv& p2 = select();
+                population_next_[i] =
+                    crossover(p1, p2, alloc, rng, tree_limits_);
+                if (!population_next_[i].tree().empty())
+                    continue;
+                // no offspring within limits
+                parent = &p1;
+            } else {
+                parent = &select();
+            }
+
+            // reproduction, tree data is shared unless copied
+            // to the arena, errors are copied with fitness
+            std::size_t parent_row = parent - population_.data();
+            std::copy(
+                errors_.begin() + parent_row * errors_case_num_,
+                errors_.begin() + (parent_row + 1) * errors_case_num_,
+                errors_next_.begin() + i * errors_case_num_);
+            population_next_[i] = Indiv(*parent, alloc);
+        }
+    };
+    if (pool_) {
+        pool_->run(population_size_, BreedChunkSize, breed);
+    } else {
+        for (std::size_t i = 0; i < population_size_; i += BreedChunkSize)
+            breed(i, std::min(i + BreedChunkSize, population_size_), 0);
+    }
 
     // swap generations
     population_.swap(population_next_);
     population_next_.clear();
+    errors_.swap(errors_next_);
+
+    // release previous generation
+    for (auto& arena : arenas_[arena_index_])
+        arena->reset();
+    arena_index_ = 1 - arena_index_;
+
+    // new cases for new generation
+    sample_stale_ = true;
+    eval_stats_ = EvalStats();
 
     // update generation counter
     ++generation_;
@@ -43,12 +191,55 @@ void Run::next_generation() {
 Population Run::harvest() {
     eval_population();
     Population harv;
-    for (const Indiv& indiv : population_)
-        if (indiv.fitness() < fitness_goal_)
-            harv.push_back(indiv);
+    for (std::size_t i = 0; i < population_.size(); ++i) {
+        const Indiv& indiv = population_[i];
+        if (indiv.fitness() < fitness_goal_) {
+            if (!sampling()) {
+                harv.push_back(indiv);
+                continue;
+            }
+            const Indiv& full = eval_full(i);
+            if (full.fitness() < fitness_goal_)
+                harv.push_back(full);
+        }
+    }
     return harv;
 }
 
+Population Run::emigrants(std::size_t n) {
+    eval_population();
+    n = std::min(n, population_.size());
+    std::vector<const Indiv*> indivs;
+    for (const Indiv& indiv : population_)
+        indivs.push_back(&indiv);
+    std::partial_sort(
+        indivs.begin(), indivs.begin() + n, indivs.end(),
+        [](const Indiv* a, const Indiv* b) {
+            return fitter(*a, *b);
+        });
+    Population migrants;
+    for (std::size_t i = 0; i < n; ++i)
+        migrants.emplace_back(*indivs[i], Tree::Allocator());
+    return migrants;
+}
+
+void Run::immigrate(const Population& migrants) {
+    eval_population();
+    std::size_t n = std::min(migrants.size(), population_.size());
+    std::vector<Indiv*> indivs;
+    for (Indiv& indiv : population_)
+        indivs.push_back(&indiv);
+    std::partial_sort(
+        indivs.begin(), indivs.begin() + n, indivs.end(),
+        [](const Indiv* a, const Indiv* b) {
+            return fitter(*b, *a);
+        });
+    for (std::size_t i = 0; i < n; ++i) {
+        *indivs[i] = migrants[i];
+        indivs[i]->reset_fitness();
+    }
+}
+
 double Run::avg_fitness() {
     eval_population();
     double sum = 0.0;
@@ -73,15 +264,559 @@ void Run::validate() {
         throw std::logic_error("Generation number is not set");
     if (population_size_ < 1)
         throw std::logic_error("Initial population not set");
-    if (fitness_cases_.empty())
+    if (fitness_cases_.empty() && dataset_.case_num() == 0)
         throw std::logic_error("No fitness cases provided");
+    update_dataset();
+    for (const auto& term : terminals_)
+        if (term->id() < 0
+            || static_cast<std::size_t>(term->id()) >= dataset_.column_num())
+        {
+            throw std::logic_error("Terminal ID has no fitness case column");
+        }
+}
+
+void Run::load_dataset(const std::string& path) {
+    dataset_.map(path);
+    fitness_cases_.clear();
+    subtree_cache_.clear();
+    fitness_cache_.clear();
+    full_indivs_.clear();
+    sample_stale_ = true;
+    for (auto& indiv : population_)
+        indiv.reset_fitness();
+}
+
+void Run::set_thread_num(std::size_t thread_num) {
+    if (thread_num == 1) {
+        pool_.reset();
+        evaluators_.clear();
+    } else {
+        pool_.reset(new ThreadPool(thread_num));
+        evaluators_.assign(pool_->thread_num(), BatchEval());
+    }
+    // arenas holding trees are kept
+    for (auto& arenas : arenas_)
+        while (arenas.size() < this->thread_num())
+            arenas.emplace_back(new Arena());
+}
+
+void Run::set_sampling(SampleMode sample_mode, std::size_t sample_size) {
+    if (sample_mode != SampleAll && sample_size == 0)
+        throw std::invalid_argument("Sample size cannot be zero");
+    sample_mode_ = sample_mode;
+    sample_size_ = sample_size;
+    sample_stale_ = true;
+    case_difficulty_.clear();
+    case_age_.clear();
+    for (auto& indiv : population_)
+        indiv.reset_fitness();
+}
+
+void Run::update_dataset() {
+    // fitness cases are only appended
+    if (!dataset_.mapped() && dataset_.case_num() != fitness_cases_.size()) {
+        dataset_.assign(fitness_cases_);
+        subtree_cache_.clear();
+        full_indivs_.clear();
+        fitness_cache_.clear();
+        sample_stale_ = true;
+    }
+}
+
+void Run::update_sample() {
+    sample_stale_ = false;
+    if (!sampling())
+        return;
+
+    std::size_t case_num = dataset_.case_num();
+    sample_rows_.clear();
+    if (sample_mode_ == SampleMiniBatch) {
+        // partial shuffle
+        if (case_order_.size() != case_num) {
+            case_order_.resize(case_num);
+            std::iota(case_order_.begin(), case_order_.end(), 0);
+        }
+        for (std::size_t i = 0; i < sample_size_; ++i) {
+            std::uniform_int_distribution<std::size_t> distr(i, case_num - 1);
+            std::swap(case_order_[i], case_order_[distr(rng_)]);
+            sample_rows_.push_back(case_order_[i]);
+        }
+        std::sort(sample_rows_.begin(), sample_rows_.end());
+
+    } else {
+        assert(sample_mode_ == SampleDss);
+        if (case_difficulty_.size() != case_num) {
+            case_difficulty_.assign(case_num, 0.0);
+            case_age_.assign(case_num, 1.0);
+        }
+        // case is selected with probability proportional to its weight,
+        // expected number of selected cases is sample size
+        auto weight = [this](std::size_t i) {
+            return std::pow(case_difficulty_[i], DssDifficultyExp)
+                + std::pow(case_age_[i], DssAgeExp);
+        };
+        double weight_sum = 0.0;
+        for (std::size_t i = 0; i < case_num; ++i)
+            weight_sum += weight(i);
+        std::uniform_real_distribution<double> distr(0.0, weight_sum);
+        for (std::size_t i = 0; i < case_num; ++i) {
+            if (distr(rng_) < weight(i) * sample_size_) {
+                sample_rows_.push_back(i);
+                case_age_[i] = 0.0;
+            }
+            case_age_[i] += 1.0;
+        }
+        if (sample_rows_.empty()) {
+            std::uniform_int_distribution<std::size_t> distr(0, case_num - 1);
+            sample_rows_.push_back(distr(rng_));
+        }
+    }
+
+    sample_.assign(dataset_, sample_rows_);
+    for (auto& indiv : population_)
+        indiv.reset_fitness();
+}
+
+void Run::update_difficulty() {
+    // number of individuals not solving the case
+    std::size_t case_num = sample_rows_.size();
+    assert(errors_.size() == population_.size() * case_num);
+    for (std::size_t k = 0; k < case_num; ++k) {
+        double difficulty = 0.0;
+        for (std::size_t i = 0; i < population_.size(); ++i)
+            if (!(std::fabs(errors_[i * case_num + k]) <= hit_tolerance_))
+                difficulty += 1.0;
+        case_difficulty_[sample_rows_[k]] = difficulty;
+    }
 }
 
 void Run::eval_population() {
-    for (auto& indiv : population_) {
-        if (!indiv.has_fitness())
-            indiv.eval(fitness_cases_, fitness_combine_method_);
+    update_dataset();
+    bool resampled = sample_stale_;
+    if (sample_stale_)
+        update_sample();
+
+    const Dataset& dataset = sampling() ? sample_ : dataset_;
+    bool dss = sampling() && sample_mode_ == SampleDss;
+
+    // errors of other cases cannot be kept
+    if (errors_case_num_ != dataset.case_num()) {
+        errors_case_num_ = dataset.case_num();
+        for (auto& indiv : population_)
+            indiv.reset_fitness();
+    }
+    errors_.resize(population_.size() * errors_case_num_);
+
+    eval_rows_.clear();
+    for (std::size_t i = 0; i < population_.size(); ++i) {
+        if (!population_[i].has_fitness()) {
+            // before looking up the tree in the cache
+            if (simplify_ == SimplifyTree)
+                population_[i].simplify_tree();
+            eval_rows_.push_back(i);
+        }
+    }
+    eval_stats_.new_num += eval_rows_.size();
+    // cached errors are only valid for the same cases
+    bool use_cache = !sampling() && fitness_cache_.capacity() > 0;
+    if (use_cache)
+        find_cached_fitness();
+
+    if (eval_unique_subtrees_) {
+        eval_population_unique_subtrees(dataset);
+
+    } else {
+        // DSS needs errors of all cases
+        double bound = (racing_ && !dss)
+            ? race_bound_
+            : std::numeric_limits<double>::infinity();
+        auto eval_range = [this, &dataset, bound](
+            std::size_t begin,
+            std::size_t end,
+            BatchEval& evaluator)
+        {
+            for (std::size_t k = begin; k < end; ++k) {
+                std::size_t i = eval_rows_[k];
+                eval_indiv(
+                    population_[i],
+                    dataset,
+                    evaluator,
+                    &errors_[i * errors_case_num_],
+                    bound);
+            }
+        };
+
+        if (pool_) {
+            pool_->run(
+                eval_rows_.size(),
+                EvalChunkSize,
+                [this, &eval_range](
+                    std::size_t begin,
+                    std::size_t end,
+                    std::size_t worker)
+                {
+                    eval_range(begin, end, evaluators_[worker]);
+                });
+        } else {
+            // cached values are only valid for the same cases
+            evaluator_.set_cache(
+                (!sampling() && subtree_cache_.capacity() > 0)
+                    ? &subtree_cache_
+                    : nullptr);
+            eval_range(0, eval_rows_.size(), evaluator_);
+        }
+    }
+
+    if (use_cache)
+        cache_fitness();
+
+    if (resampled && dss)
+        update_difficulty();
+}
+
+void Run::find_cached_fitness() {
+    // first new individual with each hash
+    std::unordered_map<std::uint64_t, std::size_t> firsts;
+    duplicates_.clear();
+    eval_hashes_.clear();
+    std::size_t n = 0;
+    for (std::size_t row : eval_rows_) {
+        Indiv& indiv = population_[row];
+        std::uint64_t hash = tree_hash(indiv.tree());
+        double fitness;
+        if (fitness_cache_.find(
+                indiv.tree(), hash, errors_case_num_,
+                fitness, &errors_[row * errors_case_num_]))
+        {
+            indiv.set_fitness(fitness);
+            ++eval_stats_.cache_hits;
+            continue;
+        }
+        auto first = firsts.find(hash);
+        if (first != firsts.end()
+            && same_tree(population_[first->second].tree(), indiv.tree()))
+        {
+            duplicates_.emplace_back(row, first->second);
+            ++eval_stats_.duplicates;
+            continue;
+        }
+        firsts.emplace(hash, row);
+        eval_rows_[n++] = row;
+        eval_hashes_.push_back(hash);
     }
+    eval_rows_.resize(n);
+}
+
+void Run::cache_fitness() {
+    for (std::size_t k = 0; k < eval_rows_.size(); ++k) {
+        const Indiv& indiv = population_[eval_rows_[k]];
+        if (!indiv.fitness_bounded())
+            fitness_cache_.insert(
+                indiv.tree(), eval_hashes_[k], errors_case_num_,
+                indiv.fitness(), &errors_[eval_rows_[k] * errors_case_num_]);
+    }
+    for (const auto& duplicate : duplicates_) {
+        const Indiv& evaluated = population_[duplicate.second];
+        population_[duplicate.first].set_fitness(
+            evaluated.fitness(), evaluated.fitness_bounded());
+        std::copy(
+            errors_.begin() + duplicate.second * errors_case_num_,
+            errors_.begin() + (duplicate.second + 1) * errors_case_num_,
+            errors_.begin() + duplicate.first * errors_case_num_);
+    }
+}
+
+void Run::eval_indiv(
+    Indiv& indiv,
+    const Dataset& dataset,
+    BatchEval& evaluator,
+    double* errors,
+    double bound)
+{
+    if (simplify_ != SimplifyNone && eval_mode_ != EvalBatch)
+        indiv.simplify_program();
+
+    switch (eval_mode_) {
+        case EvalBatch:
+            indiv.eval(
+                dataset, evaluator, fitness_combine_method_,
+                errors, bound);
+            break;
+        case EvalProgram:
+            indiv.eval(
+                dataset, fitness_combine_method_,
+                errors, false, bound);
+            break;
+        case EvalNative:
+            indiv.eval(
+                dataset,
+                fitness_combine_method_,
+                errors,
+                dataset.case_num() >= native_threshold_,
+                bound);
+            break;
+    }
+}
+
+const Indiv& Run::eval_full(std::size_t index) {
+    const Indiv& indiv = population_[index];
+    if (full_indivs_.size() != population_.size())
+        full_indivs_.resize(population_.size(), Indiv(Tree()));
+    Indiv& full = full_indivs_[index];
+    if (full.has_fitness() && same_tree(full.tree(), indiv.tree()))
+        return full;
+
+    full = indiv;
+    full.reset_fitness();
+    evaluator_.set_cache(nullptr);
+    full_errors_.resize(dataset_.case_num());
+    eval_indiv(full, dataset_, evaluator_, full_errors_.data(), fitness_goal_);
+    return full;
+}
+
+void Run::update_race_bound() {
+    if (!racing_ || population_.empty())
+        return;
+    std::vector<double> fitness;
+    fitness.reserve(population_.size());
+    for (const Indiv& indiv : population_)
+        if (!std::isnan(indiv.fitness()))
+            fitness.push_back(indiv.fitness());
+    if (fitness.empty())
+        return;
+    std::size_t n = static_cast<std::size_t>(
+        racing_percentile_ * (fitness.size() - 1));
+    std::nth_element(fitness.begin(), fitness.begin() + n, fitness.end());
+    // bounded individuals never reach the goal
+    race_bound_ = std::max(fitness[n], fitness_goal_);
 }
 
+void Run::eval_population_unique_subtrees(const Dataset& dataset) {
+    // subtrees of last evaluated individuals are kept
+    const std::vector<std::size_t>& rows = eval_rows_;
+    if (rows.empty())
+        return;
 
+    // collect unique subtrees of individuals to evaluate
+    subtrees_.clear();
+    std::vector<Dag::Id> roots;
+    for (std::size_t row : rows)
+        roots.push_back(subtrees_.intern(population_[row].tree()));
+
+    // evaluate each unique subtree once per block of fitness cases,
+    // blocks are split between threads
+    std::size_t case_num = dataset.case_num();
+    std::size_t block_num = (case_num + SubtreeBlockSize - 1) / SubtreeBlockSize;
+    const double* target = dataset.target();
+    struct Buffers {
+        std::vector<double> values;
+        std::vector<const double*> columns;
+    };
+    std::vector<Buffers> buffers(thread_num());
+    auto eval_blocks = [&](std::size_t first, std::size_t last, std::size_t worker) {
+        Buffers& buf = buffers[worker];
+        for (std::size_t block = first; block < last; ++block) {
+            std::size_t begin = block * SubtreeBlockSize;
+            std::size_t len = std::min(SubtreeBlockSize, case_num - begin);
+            subtrees_.eval(dataset, begin, len, buf.values, buf.columns);
+            for (std::size_t i = 0; i < rows.size(); ++i) {
+                const double* values = buf.columns[roots[i]];
+                double* errors = &errors_[rows[i] * case_num + begin];
+                for (std::size_t k = 0; k < len; ++k)
+                    errors[k] = values[k] - target[begin + k];
+            }
+        }
+    };
+    if (pool_)
+        pool_->run(block_num, 1, eval_blocks);
+    else
+        eval_blocks(0, block_num, 0);
+
+    for (std::size_t row : rows)
+        population_[row].set_fitness(
+            fitness_combine_method_(&errors_[row * case_num], case_num));
+}
+
+std::string Run::checkpoint() {
+    update_dataset();
+    std::string data(CheckpointMagic, sizeof(CheckpointMagic));
+    WireWriter writer(data);
+    writer.put_u32(CheckpointVersion);
+
+    // primitive set by name
+    TreeCodec tree_codec(terminals_, functions_);
+    tree_codec.write_table(writer);
+
+    // parameters
+    writer.put_u32(generation_);
+    writer.put_u32(generation_number_);
+    writer.put_double(crossover_rate_);
+    writer.put_u32(tree_limits_.max_depth);
+    writer.put_u64(tree_limits_.max_size);
+    writer.put_u8(parsimony_);
+    writer.put_double(parsimony_coefficient_);
+    writer.put_double(fitness_goal_);
+    writer.put_u8(use_arena_);
+    writer.put_u8(eval_mode_);
+    writer.put_u64(native_threshold_);
+    writer.put_u8(eval_unique_subtrees_);
+    writer.put_u8(simplify_);
+    writer.put_u8(racing_);
+    writer.put_double(racing_percentile_);
+    writer.put_double(race_bound_);
+    writer.put_u8(sample_mode_);
+    writer.put_u64(sample_size_);
+    writer.put_double(hit_tolerance_);
+
+    // random state
+    writer.put_u64(seed_);
+    for (std::uint64_t word : rng_.state())
+        writer.put_u64(word);
+
+    // fitness cases and sampling state
+    writer.put_u64(dataset_.case_num());
+    writer.put_u64(dataset_.column_num());
+    writer.put_u64(dataset_checksum(dataset_));
+    writer.put_u8(sample_stale_);
+    put_indices(writer, sample_rows_);
+    put_indices(writer, case_order_);
+    put_doubles(writer, case_difficulty_);
+    put_doubles(writer, case_age_);
+
+    // population
+    IndivCodec(tree_codec).write(writer, population_);
+    writer.put_u64(errors_case_num_);
+    put_doubles(writer, errors_);
+    return data;
+}
+
+void Run::restore(const std::string& data) {
+    update_dataset();
+    if (data.size() < sizeof(CheckpointMagic)
+        || std::memcmp(data.data(), CheckpointMagic, sizeof(CheckpointMagic)))
+    {
+        throw std::runtime_error("Not a checkpoint");
+    }
+    WireReader reader(
+        data.data() + sizeof(CheckpointMagic),
+        data.size() - sizeof(CheckpointMagic));
+    if (reader.get_u32() != CheckpointVersion)
+        throw std::runtime_error("Unsupported checkpoint version");
+
+    // saved primitives are found by name
+    TreeCodec tree_codec(reader, terminals_, functions_);
+
+    // parameters
+    unsigned generation = reader.get_u32();
+    unsigned generation_number = reader.get_u32();
+    float crossover_rate = reader.get_double();
+    TreeLimits tree_limits;
+    tree_limits.max_depth = reader.get_u32();
+    tree_limits.max_size = reader.get_u64();
+    std::uint8_t parsimony = reader.get_u8();
+    double parsimony_coefficient = reader.get_double();
+    double fitness_goal = reader.get_double();
+    bool use_arena = reader.get_u8();
+    std::uint8_t eval_mode = reader.get_u8();
+    std::size_t native_threshold = reader.get_u64();
+    bool eval_unique_subtrees = reader.get_u8();
+    std::uint8_t simplify = reader.get_u8();
+    bool racing = reader.get_u8();
+    double racing_percentile = reader.get_double();
+    double race_bound = reader.get_double();
+    std::uint8_t sample_mode = reader.get_u8();
+    std::size_t sample_size = reader.get_u64();
+    double hit_tolerance = reader.get_double();
+    if (parsimony > ParsimonyCoefficient
+        || eval_mode > EvalNative
+        || simplify > SimplifyTree
+        || sample_mode > SampleDss
+        || !(0.0 < racing_percentile && racing_percentile <= 1.0))
+    {
+        throw std::runtime_error("Invalid checkpoint: parameters");
+    }
+
+    // random state
+    std::uint64_t seed = reader.get_u64();
+    Rng::State rng_state;
+    for (std::uint64_t& word : rng_state)
+        word = reader.get_u64();
+    if (rng_state == Rng::State())
+        throw std::runtime_error("Invalid checkpoint: engine state");
+
+    // fitness cases and sampling state
+    std::size_t case_num = reader.get_u64();
+    std::size_t column_num = reader.get_u64();
+    if (case_num != dataset_.case_num()
+        || column_num != dataset_.column_num()
+        || reader.get_u64() != dataset_checksum(dataset_))
+    {
+        throw std::runtime_error("Checkpoint fitness cases do not match");
+    }
+    bool sample_stale = reader.get_u8();
+    std::vector<std::size_t> sample_rows = get_indices(reader, case_num);
+    std::vector<std::size_t> case_order = get_indices(reader, case_num);
+    std::vector<double> case_difficulty = get_doubles(reader);
+    std::vector<double> case_age = get_doubles(reader);
+    if ((!case_order.empty() && case_order.size() != case_num)
+        || (!case_difficulty.empty() && case_difficulty.size() != case_num)
+        || case_difficulty.size() != case_age.size())
+    {
+        throw std::runtime_error("Invalid checkpoint: sampling state");
+    }
+
+    // population
+    Population population = IndivCodec(tree_codec).read_population(reader);
+    for (const Indiv& indiv : population)
+        if (!indiv.tree().valid())
+            throw std::runtime_error("Invalid checkpoint: tree");
+    std::size_t errors_case_num = reader.get_u64();
+    std::vector<double> errors = get_doubles(reader);
+    if (errors.size() != population.size() * errors_case_num)
+        throw std::runtime_error("Invalid checkpoint: errors");
+    if (!reader.at_end())
+        throw std::runtime_error("Invalid checkpoint: trailing data");
+
+    generation_ = generation;
+    generation_number_ = generation_number;
+    crossover_rate_ = crossover_rate;
+    tree_limits_ = tree_limits;
+    parsimony_ = static_cast<ParsimonyMode>(parsimony);
+    parsimony_coefficient_ = parsimony_coefficient;
+    fitness_goal_ = fitness_goal;
+    use_arena_ = use_arena;
+    eval_mode_ = static_cast<EvalMode>(eval_mode);
+    native_threshold_ = native_threshold;
+    eval_unique_subtrees_ = eval_unique_subtrees;
+    simplify_ = static_cast<SimplifyMode>(simplify);
+    racing_ = racing;
+    racing_percentile_ = racing_percentile;
+    race_bound_ = race_bound;
+    sample_mode_ = static_cast<SampleMode>(sample_mode);
+    sample_size_ = sample_size;
+    hit_tolerance_ = hit_tolerance;
+    seed_ = seed;
+    rng_.set_state(rng_state);
+    sample_stale_ = sample_stale;
+    sample_rows_ = std::move(sample_rows);
+    case_order_ = std::move(case_order);
+    case_difficulty_ = std::move(case_difficulty);
+    case_age_ = std::move(case_age);
+    if (!sample_stale_ && sampling())
+        sample_.assign(dataset_, sample_rows_);
+    population_ = std::move(population);
+    population_next_.clear();
+    full_indivs_.clear();
+    population_size_ = population_.size();
+    errors_case_num_ = errors_case_num;
+    errors_ = std::move(errors);
+    eval_stats_ = EvalStats();
+}
+
+void Run::save_checkpoint(const std::string& path) {
+    write_file_atomic(path, checkpoint());
+}
+
+void Run::load_checkpoint(const std::string& path) {
+    restore(read_file(path));
+}
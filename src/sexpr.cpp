@@ -0,0 +1,173 @@
+#include "sexpr.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char EmptyName[] = "[empty]";
+
+// initial capacity of node and open function lists
+const std::size_t NodeReserveNum = 64;
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+const char* skip_space(const char* pos, const char* end) {
+    while (pos != end && is_space(*pos))
+        ++pos;
+    return pos;
+}
+
+const char* name_end(const char* pos, const char* end) {
+    while (pos != end && !is_space(*pos) && *pos != '(' && *pos != ')')
+        ++pos;
+    return pos;
+}
+
+// FNV-1a
+std::uint64_t name_hash(const char* name, std::size_t size) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(name[i])) * 0x100000001b3ULL;
+    return hash;
+}
+
+bool name_equal(const Expr* expr, const char* name, std::size_t size) {
+    return expr->name().size() == size
+        && std::memcmp(expr->name().data(), name, size) == 0;
+}
+
+template <typename List>
+std::vector<const Expr*> expr_vector(const List& list) {
+    std::vector<const Expr*> exprs;
+    for (const auto& expr : list)
+        exprs.push_back(expr.get());
+    return exprs;
+}
+
+} // namespace
+
+TreeParser::NameTable::NameTable(
+    const std::vector<const Expr*>& exprs,
+    const char* kind)
+{
+    // load factor is at most 1/2
+    std::size_t size = 1;
+    while (size < exprs.size() * 2)
+        size *= 2;
+    slots_.assign(size, nullptr);
+    for (const Expr* expr : exprs) {
+        const std::string& name = expr->name();
+        if (find(name.data(), name.size()))
+            throw std::invalid_argument(
+                std::string("Duplicate ") + kind + " name: " + name);
+        std::size_t i = name_hash(name.data(), name.size()) & (size - 1);
+        while (slots_[i])
+            i = (i + 1) & (size - 1);
+        slots_[i] = expr;
+    }
+}
+
+const Expr* TreeParser::NameTable::find(
+    const char* name,
+    std::size_t size) const
+{
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = name_hash(name, size) & mask;
+         slots_[i];
+         i = (i + 1) & mask)
+    {
+        if (name_equal(slots_[i], name, size))
+            return slots_[i];
+    }
+    return nullptr;
+}
+
+TreeParser::TreeParser(const TermList& term_list, const FuncList& func_list)
+    : terms_(expr_vector(term_list), "terminal"),
+      funcs_(expr_vector(func_list), "function") {}
+
+Tree TreeParser::parse(
+    const char*& pos,
+    const char* end,
+    const Tree::Allocator& alloc) const
+{
+    Tree::NodeList nodes;
+    nodes.reserve(NodeReserveNum);
+    // open functions and their arguments left to read
+    std::vector<std::pair<const Expr*, unsigned>> open;
+    open.reserve(NodeReserveNum);
+    const char* p = pos;
+    do {
+        p = skip_space(p, end);
+        if (p == end)
+            throw std::runtime_error("Unexpected end of tree");
+        bool call = (*p == '(');
+        if (call)
+            p = skip_space(p + 1, end);
+        const char* name = p;
+        p = name_end(p, end);
+        std::size_t name_size = p - name;
+        if (name_size == 0)
+            throw std::runtime_error("Expected name");
+
+        if (!open.empty())
+            --open.back().second;
+        if (call) {
+            const Expr* func = funcs_.find(name, name_size);
+            if (!func)
+                throw std::runtime_error(
+                    "Unknown function: " + std::string(name, name_size));
+            nodes.emplace_back(func);
+            open.emplace_back(func, nodes.back().arity);
+        } else if (const Expr* term = terms_.find(name, name_size)) {
+            nodes.emplace_back(term);
+        } else if (name_size == sizeof(EmptyName) - 1
+                   && std::memcmp(name, EmptyName, name_size) == 0)
+        {
+            nodes.emplace_back(nullptr);
+        } else {
+            throw std::runtime_error(
+                "Unknown terminal: " + std::string(name, name_size));
+        }
+
+        // close functions with all arguments read
+        while (!open.empty() && open.back().second == 0) {
+            p = skip_space(p, end);
+            if (p == end)
+                throw std::runtime_error("Unexpected end of tree");
+            if (*p != ')')
+                throw std::runtime_error(
+                    "Too many arguments: " + open.back().first->name());
+            ++p;
+            open.pop_back();
+        }
+        if (!open.empty()) {
+            p = skip_space(p, end);
+            if (p != end && *p == ')')
+                throw std::runtime_error(
+                    "Too few arguments: " + open.back().first->name());
+        }
+    } while (!open.empty());
+
+    pos = p;
+    if (!nodes[0].expr)
+        return Tree();
+    return Tree(nodes, alloc);
+}
+
+Tree TreeParser::parse(
+    const std::string& s,
+    const Tree::Allocator& alloc) const
+{
+    const char* pos = s.data();
+    const char* end = pos + s.size();
+    Tree tree = parse(pos, end, alloc);
+    if (skip_space(pos, end) != end)
+        throw std::runtime_error("Unexpected data after tree");
+    return tree;
+}
@@ -0,0 +1,202 @@
+#include "simplify.hpp"
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+Simplified::Node make_node(
+    const Expr* expr,
+    double value,
+    unsigned arity,
+    std::size_t source)
+{
+    Simplified::Node node;
+    node.expr = expr;
+    node.value = value;
+    node.size = 1;
+    node.arity = arity;
+    node.source = source;
+    return node;
+}
+
+bool is_const(const Simplified::NodeList& nodes, std::size_t pos, double value) {
+    return !nodes[pos].expr && nodes[pos].value == value;
+}
+
+// true if subtrees at `a' and `b' are the same
+bool equal(const Simplified::NodeList& nodes, std::size_t a, std::size_t b) {
+    if (nodes[a].size != nodes[b].size)
+        return false;
+    for (std::size_t i = 0; i < nodes[a].size; ++i) {
+        const Simplified::Node& x = nodes[a + i];
+        const Simplified::Node& y = nodes[b + i];
+        if (x.expr != y.expr || (!x.expr && !(x.value == y.value)))
+            return false;
+    }
+    return true;
+}
+
+Builtin builtin(const Simplified::Node& node) {
+    return (node.expr && node.expr->is_func())
+        ? static_cast<const Func*>(node.expr)->builtin()
+        : BuiltinNone;
+}
+
+} // namespace
+
+Simplified::Simplified(const Tree& tree)
+    : tree_(tree)
+{
+    if (!tree.valid())
+        throw std::invalid_argument("Cannot simplify invalid tree");
+    nodes_.reserve(tree.node_num());
+    build(0);
+}
+
+void Simplified::build(std::size_t pos) {
+    const Tree::Node& node = tree_.node(pos);
+    std::size_t start = nodes_.size();
+    nodes_.push_back(make_node(node.expr, 0.0, node.arity, pos));
+    if (node.expr->is_term())
+        return;
+
+    // simplify children
+    std::vector<std::size_t> children;
+    bool all_const = true;
+    std::size_t child_pos = pos + 1;
+    for (unsigned i = 0; i < node.arity; ++i) {
+        children.push_back(nodes_.size());
+        build(child_pos);
+        child_pos = tree_.subtree_end(child_pos);
+        if (nodes_[children.back()].expr)
+            all_const = false;
+    }
+
+    // replace node with constant folded from subtree at `source'
+    auto make_const = [this, start](double value, std::size_t source) {
+        nodes_.resize(start);
+        nodes_.push_back(make_node(nullptr, value, 0, source));
+    };
+    // replace node with its i-th child
+    auto keep = [this, start, &children](std::size_t i) {
+        nodes_.erase(nodes_.begin() + start, nodes_.begin() + children[i]);
+        nodes_.resize(start + nodes_[start].size);
+    };
+    auto is_zero = [this, &children](std::size_t i) {
+        return is_const(nodes_, children[i], 0.0);
+    };
+    auto is_one = [this, &children](std::size_t i) {
+        return is_const(nodes_, children[i], 1.0);
+    };
+    auto source = [this, &children](std::size_t i) {
+        return nodes_[children[i]].source;
+    };
+    // true if i-th child is (% x x), where x is j-th child
+    auto is_self_div = [this, &children](std::size_t i, std::size_t j) {
+        std::size_t div = children[i];
+        if (builtin(nodes_[div]) != BuiltinSafeDiv2)
+            return false;
+        std::size_t a = div + 1;
+        std::size_t b = a + nodes_[a].size;
+        return equal(nodes_, a, b) && equal(nodes_, a, children[j]);
+    };
+
+    assert(node.expr->is_func());
+    const Func* func = static_cast<const Func*>(node.expr);
+    if (all_const) {
+        Params args;
+        for (std::size_t child : children)
+            args.push_back(nodes_[child].value);
+        double value = func->eval(args);
+        // smaller subtree with the same value
+        std::size_t value_source = pos;
+        for (std::size_t i = 0; i < children.size(); ++i)
+            if (is_const(nodes_, children[i], value))
+                value_source = source(i);
+        make_const(value, value_source);
+        return;
+    }
+
+    // Rules hold for finite values of removed subtrees only:
+    // x - x, x * 0 and 0 % x are NaN and x * (x % x) is NaN
+    // for infinite x, all are NaN for NaN x, the rules give 0 or x.
+    // (+ x 0) gives 0 for x = -0, which compares equal.
+    switch (func->builtin()) {
+        case BuiltinPlus2:
+            if (is_zero(0))
+                return keep(1);
+            if (is_zero(1))
+                return keep(0);
+            break;
+        case BuiltinMinus2:
+            if (is_zero(1))
+                return keep(0);
+            if (equal(nodes_, children[0], children[1]))
+                return make_const(0.0, pos);
+            break;
+        case BuiltinMult2:
+            if (is_zero(0))
+                return make_const(0.0, source(0));
+            if (is_zero(1))
+                return make_const(0.0, source(1));
+            if (is_one(0) || is_self_div(0, 1))
+                return keep(1);
+            if (is_one(1) || is_self_div(1, 0))
+                return keep(0);
+            break;
+        case BuiltinMult3:
+            for (std::size_t i = 0; i < children.size(); ++i)
+                if (is_zero(i))
+                    return make_const(0.0, source(i));
+            break;
+        case BuiltinSafeDiv2:
+            if (is_zero(0))
+                return make_const(0.0, source(0));
+            if (is_zero(1))
+                return make_const(0.0, source(1));
+            if (is_one(1))
+                return keep(0);
+            break;
+        default:
+            break;
+    }
+    nodes_[start].size = nodes_.size() - start;
+}
+
+Tree Simplified::tree(const Tree::Allocator& alloc) const {
+    Tree::NodeList nodes;
+    nodes.reserve(tree_.node_num());
+    for (const Node& node : nodes_) {
+        if (node.expr) {
+            nodes.emplace_back(node.expr);
+            continue;
+        }
+        // copy subtree the constant was folded from
+        std::size_t end = tree_.subtree_end(node.source);
+        for (std::size_t pos = node.source; pos < end; ++pos)
+            nodes.emplace_back(tree_.node(pos).expr);
+    }
+    return Tree(nodes, alloc);
+}
+
+std::string Simplified::as_string() const {
+    std::size_t pos = 0;
+    return do_as_string(pos);
+}
+
+std::string Simplified::do_as_string(std::size_t& pos) const {
+    const Node& node = nodes_[pos++];
+    if (!node.expr) {
+        std::ostringstream out;
+        out << node.value;
+        return out.str();
+    }
+    if (node.expr->is_term())
+        return node.expr->get_name();
+
+    std::string s = "(" + node.expr->get_name();
+    for (unsigned i = 0; i < node.arity; ++i)
+        s += " " + do_as_string(pos);
+    return s + ")";
+}
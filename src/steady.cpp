@@ -0,0 +1,255 @@
+#include "steady.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+SteadyState::SteadyState(Run& run)
+    : run_(run),
+      evaluation_number_(0),
+      thread_num_(1),
+      seed_(run.seed()),
+      advance_num_(0),
+      evaluations_(0),
+      limit_(0),
+      stop_(false),
+      evaluated_(false),
+      workers_(1),
+      population_(run.population()),
+      locks_(population_.size())
+{
+    if (population_.empty())
+        throw std::logic_error("Initial population not set");
+    // fitness may be relative to a sample
+    for (auto& indiv : population_)
+        indiv.reset_fitness();
+}
+
+void SteadyState::set_thread_num(std::size_t thread_num) {
+    if (thread_num == 0)
+        thread_num = std::max(1u, std::thread::hardware_concurrency());
+    thread_num_ = thread_num;
+    workers_.resize(thread_num_);
+}
+
+bool SteadyState::finished() {
+    return evaluations_ >= evaluation_number_
+        || solution_found();
+}
+
+bool SteadyState::solution_found() {
+    eval_population();
+    return std::any_of(
+        population_.begin(), population_.end(),
+        [this](const Indiv& indiv) {
+            return indiv.fitness() < run_.fitness_goal();
+        });
+}
+
+void SteadyState::advance(std::size_t evaluation_num) {
+    if (evaluation_number_ < 1)
+        throw std::logic_error("Evaluation number is not set");
+    eval_population();
+    if (finished())
+        return;
+
+    const Dataset& dataset = run_.dataset();
+    limit_ = evaluations_
+        + std::min(evaluation_num, evaluation_number_ - evaluations_);
+    stop_ = false;
+    ++advance_num_;
+    run_threads([this, &dataset](std::size_t thread) {
+        Rng rng = make_rng(seed_, advance_num_, thread);
+        while (!stop_ && evaluations_++ < limit_)
+            step(dataset, rng, workers_[thread]);
+    });
+    // evaluations claimed past the limit
+    evaluations_ = std::min<std::size_t>(evaluations_, limit_);
+}
+
+Population SteadyState::harvest() {
+    eval_population();
+    Population harv;
+    for (const Indiv& indiv : population_)
+        if (indiv.fitness() < run_.fitness_goal())
+            harv.push_back(indiv);
+    return harv;
+}
+
+double SteadyState::avg_fitness() {
+    eval_population();
+    double sum = 0.0;
+    for (const Indiv& indiv : population_)
+        sum += indiv.fitness();
+    return sum / population_.size();
+}
+
+std::pair<double, double> SteadyState::best_worst_fitness() {
+    eval_population();
+    double best = std::numeric_limits<double>::max();
+    double worst = 0.0;
+    for (const Indiv& indiv : population_) {
+        best = std::min(best, indiv.fitness());
+        worst = std::max(worst, indiv.fitness());
+    }
+    return std::make_pair(best, worst);
+}
+
+void SteadyState::run_threads(
+    const std::function<void(std::size_t thread)>& task)
+{
+    std::vector<std::exception_ptr> errors(thread_num_);
+    auto run_task = [this, &task, &errors](std::size_t thread) {
+        try {
+            task(thread);
+        } catch (...) {
+            errors[thread] = std::current_exception();
+            stop_ = true; // stop other threads
+        }
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < thread_num_; ++i)
+        threads.emplace_back(run_task, i);
+    run_task(0);
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+void SteadyState::eval_population() {
+    if (evaluated_)
+        return;
+
+    const Dataset& dataset = run_.dataset();
+    if (dataset.case_num() == 0)
+        throw std::logic_error("No fitness cases provided");
+    for (const auto& term : run_.terminals())
+        if (term->id() < 0
+            || static_cast<std::size_t>(term->id()) >= dataset.column_num())
+        {
+            throw std::logic_error("Terminal ID has no fitness case column");
+        }
+
+    std::atomic<std::size_t> next(0);
+    stop_ = false;
+    run_threads([this, &dataset, &next](std::size_t thread) {
+        std::size_t i;
+        while (!stop_ && (i = next++) < population_.size())
+            eval(
+                population_[i], dataset, workers_[thread],
+                std::numeric_limits<double>::infinity());
+    });
+    evaluated_ = true;
+}
+
+void SteadyState::eval(
+    Indiv& indiv,
+    const Dataset& dataset,
+    Worker& worker,
+    double bound)
+{
+    if (run_.simplify() == Run::SimplifyTree)
+        indiv.simplify_tree();
+    if (run_.simplify() != Run::SimplifyNone
+        && run_.eval_mode() != Run::EvalBatch)
+    {
+        indiv.simplify_program();
+    }
+
+    worker.errors.resize(dataset.case_num());
+    switch (run_.eval_mode()) {
+        case Run::EvalBatch:
+            indiv.eval(
+                dataset, worker.evaluator, run_.fitness_combine_method(),
+                worker.errors.data(), bound);
+            break;
+        case Run::EvalProgram:
+            indiv.eval(
+                dataset, run_.fitness_combine_method(),
+                worker.errors.data(), false, bound);
+            break;
+        case Run::EvalNative:
+            indiv.eval(
+                dataset,
+                run_.fitness_combine_method(),
+                worker.errors.data(),
+                dataset.case_num() >= run_.native_threshold(),
+                bound);
+            break;
+    }
+}
+
+Indiv SteadyState::get(std::size_t index) {
+    std::lock_guard<std::mutex> lock(locks_[index]);
+    return population_[index];
+}
+
+void SteadyState::step(const Dataset& dataset, Rng& rng, Worker& worker) {
+    std::uniform_int_distribution<std::size_t> slot(0, population_.size() - 1);
+    auto fitter = [this](const Indiv& a, const Indiv& b) {
+        return ::fitter(
+            a, b, run_.parsimony(), run_.parsimony_coefficient());
+    };
+    auto select = [this, &slot, &rng, &fitter]() {
+        Indiv cont1 = get(slot(rng));
+        Indiv cont2 = get(slot(rng));
+        return fitter(cont1, cont2) ? cont1 : cont2;
+    };
+
+    // inverse tournament, least fit is replaced
+    std::size_t victim = slot(rng);
+    double victim_fitness;
+    std::size_t victim_size;
+    {
+        std::size_t other = slot(rng);
+        Indiv cont1 = get(victim);
+        Indiv cont2 = get(other);
+        if (fitter(cont1, cont2))
+            victim = other;
+        const Indiv& loser = (victim == other) ? cont2 : cont1;
+        victim_fitness = loser.fitness();
+        victim_size = loser.tree().node_num();
+    }
+
+    Indiv offspring(Tree{});
+    std::uniform_real_distribution<float> distr(0.0, 1.0);
+    if (distr(rng) < run_.crossover_rate()) {
+        Indiv p1 = select();
+        Indiv p2 = select();
+        offspring = crossover(
+            p1, p2, Tree::Allocator(), rng, run_.tree_limits());
+        if (offspring.tree().empty()) {
+            // no offspring within limits
+            offspring = p1;
+        } else {
+            double bound = std::numeric_limits<double>::infinity();
+            if (run_.racing() && !std::isnan(victim_fitness)) {
+                // fitness offspring must not exceed to replace victim
+                bound = victim_fitness;
+                if (run_.parsimony() == ParsimonyCoefficient)
+                    bound += run_.parsimony_coefficient()
+                        * (static_cast<double>(victim_size)
+                           - static_cast<double>(offspring.tree().node_num()));
+            }
+            eval(offspring, dataset, worker, bound);
+        }
+    } else {
+        // reproduction
+        offspring = select();
+    }
+
+    // bounded offspring is less fit than the victim
+    if (offspring.fitness_bounded())
+        return;
+    if (offspring.fitness() < run_.fitness_goal())
+        stop_ = true;
+    {
+        std::lock_guard<std::mutex> lock(locks_[victim]);
+        if (!fitter(population_[victim], offspring))
+            std::swap(population_[victim], offspring);
+    }
+    // replaced individual is released here, outside of the lock
+}
@@ -1,243 +1,365 @@
 #include "tree.hpp"
+#include <cstring>
+#include <new>
+#include <ostream>
 
-// TODO: use initialization list
-Tree::Tree(const Tree& other) {
-    parent_ = nullptr;
-    expr_ = other.expr_;
-    children_ = other.children_;
+static_assert(
+    std::is_trivially_copyable<Tree::Node>::value,
+    "Tree nodes have to be trivially copyable");
+
+Tree::Tree(const std::shared_ptr<Expr>& expr)
+    : data_(nullptr)
+{
+    if (expr) {
+        NodeList nodes(1 + expr->arity()); // missing children
+        nodes[0] = Node(expr.get());
+        *this = Tree(nodes);
+    }
+}
+
+Tree::Tree(const NodeList& nodes, const Allocator& alloc)
+    : data_(nullptr)
+{
+    if (nodes.empty())
+        return;
+    data_ = allocate(nodes.size(), alloc.arena());
+    std::copy(nodes.cbegin(), nodes.cend(), data_->nodes());
+    try {
+        update_nodes();
+    } catch (...) {
+        release();
+        throw;
+    }
+    update_index();
 }
 
-// TODO: use initialization list
-Tree::Tree(Tree&& other) {
-    parent_ = nullptr;
-    expr_ = std::move(other.expr_);
-    children_ = std::move(other.children_);
+Tree::Tree(const Tree& other)
+    : Tree(other, Allocator()) {}
+
+Tree::Tree(const Tree& other, const Allocator& alloc)
+    : data_(nullptr)
+{
+    if (!other.data_)
+        return;
+
+    if (other.data_->arena == alloc.arena()) {
+        // share
+        data_ = other.data_;
+        ++data_->refs;
+    } else {
+        // copy
+        data_ = allocate(other.data_->node_num, alloc.arena());
+        data_->index_num = other.data_->index_num;
+        data_->func_num = other.data_->func_num;
+        std::memcpy(
+            data_->nodes(),
+            other.data_->nodes(),
+            other.data_->node_num * sizeof(Node));
+        std::memcpy(
+            data_->index(),
+            other.data_->index(),
+            other.data_->index_num * sizeof(std::uint32_t));
+    }
 }
 
 Tree& Tree::operator=(const Tree& other) {
-    parent_ = nullptr;
-    expr_ = other.expr_;
-    children_ = other.children_;
+    Tree copy(other);
+    std::swap(data_, copy.data_);
     return *this;
 }
 
-Tree& Tree::operator=(Tree&& other) {
-    parent_ = nullptr;
-    expr_ = std::move(other.expr_);
-    children_ = std::move(other.children_);
+Tree& Tree::operator=(Tree&& other) noexcept {
+    std::swap(data_, other.data_);
     return *this;
 }
 
 bool Tree::valid() const {
-    if (empty()) {
+    if (empty())
         return false;
-    } else if (expr_->is_term()) {
-        return true;
-    } else if (expr_->is_func()) {
-        // TODO: replace with std::any_of
-        auto it = std::find_if(
-            children_.cbegin(),
-            children_.cend(),
-            [](const Tree& t) {
-                return !t.valid();
-            });
-        return it == children_.cend();
-    }
-    assert(false);
+    return std::all_of(
+        begin(),
+        end(),
+        [](const Node& node) {
+            return node.expr != nullptr;
+        });
 }
 
 double Tree::get_value(const Params& params) const {
     assert(valid());
 
-    if (expr_->is_term()) {
-        return expr_->eval(params);
-
-    } else if (expr_->is_func()) {
-        Params args(children_.size());
-        std::transform(
-            children_.cbegin(), children_.cend(),
-            args.begin(),
-            [=](const Tree& c) {
-                return c.get_value(params);
-            });
-        return expr_->eval(args);
-    }
-    assert(false);
-}
-
-std::size_t Tree::term_num() const {
-    assert(!empty());
+    // evaluate in reverse prefix order,
+    // first argument of a function is on top of the stack
+    Params stack;
+    stack.reserve(node_num());
+    Params args;
+    for (const Node* node = end(); node-- != begin();) {
+        const Expr* expr = node->expr;
+        if (expr->is_term()) {
+            stack.push_back(expr->eval(params));
+
+        } else if (expr->is_func()) {
+            // arguments are read in place by stack functions
+            const Func* func = static_cast<const Func*>(expr);
+            double value;
+            if (func->stack_func()) {
+                value = func->stack_func()(stack.data() + stack.size());
+            } else {
+                args.assign(stack.crbegin(), stack.crbegin() + node->arity);
+                value = expr->eval(args);
+            }
+            stack.resize(stack.size() - node->arity);
+            stack.push_back(value);
 
-    if (expr_->is_term()) {
-        return 1;
-    } else {
-        std::size_t num = 0;
-        for (const auto& c : children_)
-            num += c.term_num();
-        return num;
+        } else {
+            assert(false);
+        }
     }
+    assert(stack.size() == 1);
+    return stack.back();
 }
 
-std::size_t Tree::func_num() const {
-    assert(!empty());
-
-    if (expr_->is_term()) {
-        return 0;
-    } else {
-        std::size_t num = 1;
-        for (const auto& c : children_)
-            num += c.func_num();
-        return num;
-    }
+Tree Tree::subtree(std::size_t pos) const {
+    Tree root(NodeList(1)); // missing root to replace
+    return splice(root, 0, *this, pos);
 }
 
-void Tree::set_child(std::size_t index, Tree subtree) {
+void Tree::set_child(std::size_t index, const Tree& subtree) {
     if (index >= child_num())
         throw std::out_of_range("Invalid node child index");
-    children_[index] = std::move(subtree);
-    children_[index].parent_ = this;
+
+    std::size_t pos = 1;
+    for (std::size_t i = 0; i < index; ++i)
+        pos = subtree_end(pos);
+    replace_subtree(pos, subtree);
 }
 
-Tree& Tree::random_subtree(float p_term) {
-    return const_cast<Tree&>(
-        const_cast<const Tree*>(this)->random_subtree(p_term));
+void Tree::replace_subtree(std::size_t pos, const Tree& subtree) {
+    subtree_end(pos); // check position
+    *this = subtree.data_
+        ? splice(*this, pos, subtree, 0, allocator())
+        : splice(*this, pos, Tree(NodeList(1)), 0, allocator());
 }
 
-const Tree& Tree::random_subtree(float p_term) const {
-    // std::cout << "random_subtree: P[term] = " << p_term << std::endl;
+unsigned Tree::node_depth(std::size_t pos) const {
+    subtree_end(pos); // check position
+    const Node* nodes = data_->nodes();
+    unsigned depth = 0;
+    std::size_t cur = 0;
+    while (cur != pos) {
+        // skip children preceding the one containing pos
+        std::size_t child = cur + 1;
+        while (child + nodes[child].size <= pos)
+            child += nodes[child].size;
+        cur = child;
+        ++depth;
+    }
+    return depth;
+}
+
+std::size_t Tree::random_subtree(float p_term, Rng& rng) const {
     assert(term_num() > 0);
     assert(p_term < 1.0);
-    // std::cout << "func num = " << func_num() << std::endl;
-    // std::cout << "term num = " << term_num() << std::endl;
 
     // check if tree is terminal
     if (func_num() == 0)
-        return *this;
+        return 0;
 
-    std::random_device rd;
     std::uniform_real_distribution<float> distr(0, 1.0);
-    return (distr(rd) < p_term)
-        ? random_term()
-        : random_func();
+    return (distr(rng) < p_term)
+        ? random_term(rng)
+        : random_func(rng);
 }
 
-Tree& Tree::random_term() {
-    return const_cast<Tree&>(
-        const_cast<const Tree*>(this)->random_term());
-}
-
-const Tree& Tree::random_term() const {
+std::size_t Tree::random_term(Rng& rng) const {
     assert(term_num() > 0);
 
-    std::random_device rd;
     std::uniform_int_distribution<std::size_t> distr(
         0, term_num() - 1);
-    std::size_t tn = distr(rd);
-    // std::cout << "random term: " << tn << std::endl;
-    return nth_term(tn);
+    return nth_term(distr(rng));
 }
 
-Tree& Tree::nth_term(std::size_t n) {
-    return const_cast<Tree&>(
-        const_cast<Tree*>(this)->nth_term(n));
+std::size_t Tree::random_func(Rng& rng) const {
+    assert(func_num() > 0);
+
+    std::uniform_int_distribution<std::size_t> distr(
+        0, func_num() - 1);
+    return nth_func(distr(rng));
 }
 
-const Tree& Tree::nth_term(std::size_t n) const {
-    assert(!empty());
-    if (n + 1 > term_num())
-        throw std::out_of_range("Terminal number is out of range");
+namespace {
 
-    if (n == 0) {
-        return expr_->is_term()
-            ? *this
-            : children_[0].nth_term(0);
-    } else {
-        std::size_t skipped = 0;
-        for (auto& c : children_) {
-            if (skipped + c.term_num() > n)
-                return c.nth_term(n - skipped);
-            skipped += c.term_num();
-        }
-        assert(false);
+// Sinks for write_tree
+
+class StringSink {
+public:
+    explicit StringSink(std::string& out)
+        : out_(out) {}
+
+    void put(char c) {
+        out_.push_back(c);
     }
-}
 
-Tree& Tree::random_func() {
-    return const_cast<Tree&>(
-        const_cast<Tree*>(this)->random_func());
-}
+    void put(const std::string& s) {
+        out_ += s;
+    }
 
-const Tree& Tree::random_func() const {
-    assert(func_num() > 0);
+private:
+    std::string& out_;
+};
 
-    std::random_device rd;
-    std::uniform_int_distribution<std::size_t> distr(
-        0, func_num() - 1);
-    std::size_t fn = distr(rd);
-    // std::cout << "random func: " << fn << " from " << func_num() << std::endl;
-    return nth_func(fn);
-}
+// buffers output to write stream in large blocks
+class StreamSink {
+public:
+    explicit StreamSink(std::ostream& out)
+        : out_(out),
+          size_(0) {}
 
-Tree& Tree::nth_func(std::size_t n) {
-    return const_cast<Tree&>(
-        const_cast<Tree*>(this)->nth_func(n));
-}
+    ~StreamSink() {
+        flush();
+    }
 
-const Tree& Tree::nth_func(std::size_t n) const {
-    assert(!empty());
+    void put(char c) {
+        if (size_ == sizeof(buffer_))
+            flush();
+        buffer_[size_++] = c;
+    }
 
-    if (n + 1 > func_num())
-        throw std::out_of_range("Function number is out of range");
+    void put(const std::string& s) {
+        if (size_ + s.size() > sizeof(buffer_))
+            flush();
+        if (s.size() > sizeof(buffer_)) {
+            out_.write(s.data(), s.size());
+            return;
+        }
+        std::memcpy(buffer_ + size_, s.data(), s.size());
+        size_ += s.size();
+    }
 
-    if (n == 0) {
-        return *this;
-    } else {
-        std::size_t skipped = 1; // skip oneself
-        for (auto& c : children_) {
-            if (skipped + c.func_num() > n)
-                return c.nth_func(n - skipped);
-            skipped += c.func_num();
+    void flush() {
+        out_.write(buffer_, size_);
+        size_ = 0;
+    }
+
+private:
+    std::ostream& out_;
+    char buffer_[4096];
+    std::size_t size_;
+};
+
+// counts characters past the end of buffer
+class BufferSink {
+public:
+    BufferSink(char* buffer, std::size_t size)
+        : buffer_(buffer),
+          size_(size),
+          length_(0) {}
+
+    void put(char c) {
+        if (length_ < size_)
+            buffer_[length_] = c;
+        ++length_;
+    }
+
+    void put(const std::string& s) {
+        if (length_ < size_)
+            std::memcpy(
+                buffer_ + length_, s.data(),
+                std::min(s.size(), size_ - length_));
+        length_ += s.size();
+    }
+
+    std::size_t length() const {
+        return length_;
+    }
+
+private:
+    char* buffer_;
+    std::size_t size_;
+    std::size_t length_;
+};
+
+const std::string EmptyString = "[empty]";
+
+// write nodes in prefix order, closing parentheses
+// are added after last child of each function
+template <typename Sink>
+void write_tree(const Tree& tree, Sink& sink) {
+    if (tree.node_num() == 0) {
+        sink.put(EmptyString);
+        return;
+    }
+    std::vector<unsigned> open; // children left for open functions
+    open.reserve(tree.depth() + 1);
+    for (const Tree::Node& node : tree) {
+        if (!open.empty()) {
+            sink.put(' ');
+            --open.back();
+        }
+        if (!node.expr) {
+            sink.put(EmptyString);
+        } else if (node.expr->is_term()) {
+            sink.put(node.expr->name());
+        } else {
+            sink.put('(');
+            sink.put(node.expr->name());
+            open.push_back(node.arity);
+        }
+        while (!open.empty() && open.back() == 0) {
+            sink.put(')');
+            open.pop_back();
         }
-        // std::cout << "n = " << n << std::endl;
-        // std::cout << "func num: " << func_num() << std::endl;
-        // std::cout << as_pretty_string() << std::endl;
-        assert(false);
     }
 }
 
+} // namespace
+
 std::string Tree::as_string() const {
-    if (empty()) return "[empty]";
+    std::string s;
+    StringSink sink(s);
+    write_tree(*this, sink);
+    return s;
+}
 
-    if (expr_->is_term()) {
-        return expr_->get_name();
+void Tree::write(std::ostream& out) const {
+    StreamSink sink(out);
+    write_tree(*this, sink);
+}
 
-    } else if (expr_->is_func()) {
-        std::string s = "(" + expr_->get_name();
-        for (const auto& c : children_)
-            s += " " + c.as_string();
-        s += ")";
-        return s;
-    }
-    assert(false);
+std::size_t Tree::write(char* buffer, std::size_t size) const {
+    BufferSink sink(buffer, size);
+    write_tree(*this, sink);
+    return sink.length();
 }
 
-std::string Tree::do_as_pretty_string(std::size_t offset) const {
+std::string Tree::as_pretty_string() const {
+    if (!data_) return "[empty]";
+
+    std::size_t pos = 0;
+    return do_as_pretty_string(pos, 0);
+}
+
+std::string Tree::do_as_pretty_string(
+    std::size_t& pos,
+    std::size_t offset) const
+{
     static const std::size_t arg_width_max = 10;
 
-    if (empty()) return "[empty]";
+    const Node& node = data_->nodes()[pos++];
+    if (!node.expr) return "[empty]";
 
-    if (expr_->is_term()) {
-        return expr_->get_name();
+    if (node.expr->is_term()) {
+        return node.expr->get_name();
 
-    } else if (expr_->is_func()) {
-        std::string s = "(" + expr_->get_name();
+    } else if (node.expr->is_func()) {
+        std::string s = "(" + node.expr->get_name();
         std::size_t newline_offset = s.size() + 1; // func name + 1 space
 
         // collect children strings
         bool add_newlines = false;
         std::vector<std::string> subs;
-        for (const auto& c : children_) {
-            std::string sub = c.do_as_pretty_string(offset + newline_offset);
+        for (unsigned i = 0; i < node.arity; ++i) {
+            std::string sub = do_as_pretty_string(
+                pos, offset + newline_offset);
             if (!add_newlines) {
                 add_newlines =
                     (sub.find('\n') != std::string::npos)
@@ -268,41 +390,216 @@ std::string Tree::do_as_pretty_string(std::size_t offset) const {
     assert(false);
 }
 
-Tree full(
+Tree::Data* Tree::allocate(std::size_t node_num, Arena* arena) {
+    std::size_t size = sizeof(Data)
+        + node_num * (sizeof(Node) + sizeof(std::uint32_t));
+    void* ptr = arena
+        ? arena->allocate(size, alignof(Data))
+        : ::operator new(size);
+    Data* data = new (ptr) Data;
+    data->refs = 1;
+    data->arena = arena;
+    data->node_num = node_num;
+    data->index_num = 0;
+    data->func_num = 0;
+    return data;
+}
+
+void Tree::release() {
+    if (data_ && --data_->refs == 0) {
+        Arena* arena = data_->arena;
+        data_->~Data();
+        if (!arena)
+            ::operator delete(data_);
+    }
+    data_ = nullptr;
+}
+
+void Tree::update_nodes() {
+    // children follow their parent, so calculate in reverse order
+    Node* nodes = data_->nodes();
+    std::vector<std::size_t> stack; // positions of subtrees
+    for (std::size_t pos = data_->node_num; pos-- > 0;) {
+        Node& node = nodes[pos];
+        if (stack.size() < node.arity)
+            throw std::invalid_argument("Invalid tree node list");
+        node.size = 1;
+        node.height = 0;
+        for (unsigned i = 0; i < node.arity; ++i) {
+            const Node& child = nodes[stack.back()];
+            stack.pop_back();
+            node.size += child.size;
+            node.height = std::max<unsigned>(node.height, child.height + 1);
+        }
+        stack.push_back(pos);
+    }
+    if (stack.size() > 1)
+        throw std::invalid_argument("Invalid tree node list");
+}
+
+void Tree::update_path(std::size_t ancestor, std::size_t pos, long delta) {
+    if (ancestor == pos)
+        return;
+
+    Node* nodes = data_->nodes();
+    Node& node = nodes[ancestor];
+    node.size += delta;
+
+    // find child containing pos, sizes of preceding siblings are unchanged
+    std::size_t child = ancestor + 1;
+    while (child + nodes[child].size <= pos)
+        child += nodes[child].size;
+    update_path(child, pos, delta);
+
+    node.height = 0;
+    child = ancestor + 1;
+    for (unsigned i = 0; i < node.arity; ++i) {
+        node.height = std::max<unsigned>(
+            node.height, nodes[child].height + 1);
+        child += nodes[child].size;
+    }
+}
+
+void Tree::update_index() {
+    const Node* nodes = data_->nodes();
+    std::uint32_t* index = data_->index();
+    std::size_t num = 0;
+    for (std::size_t pos = 0; pos < data_->node_num; ++pos)
+        if (nodes[pos].expr && nodes[pos].expr->is_func())
+            index[num++] = pos;
+    data_->func_num = num;
+    for (std::size_t pos = 0; pos < data_->node_num; ++pos)
+        if (nodes[pos].expr && nodes[pos].expr->is_term())
+            index[num++] = pos;
+    data_->index_num = num;
+}
+
+// copy positions from sorted [first, last) within [begin, end)
+// to `index', shifted by `offset', returns new end of `index'
+static std::uint32_t* copy_positions(
+    std::uint32_t* index,
+    const std::uint32_t* first,
+    const std::uint32_t* last,
+    std::size_t begin,
+    std::size_t end,
+    long offset)
+{
+    first = std::lower_bound(first, last, begin);
+    last = std::lower_bound(first, last, end);
+    for (; first != last; ++first)
+        *index++ = *first + offset;
+    return index;
+}
+
+Tree splice(
+    const Tree& recipient,
+    std::size_t pos,
+    const Tree& donor,
+    std::size_t donor_pos,
+    const Tree::Allocator& alloc)
+{
+    std::size_t end = recipient.subtree_end(pos);
+    std::size_t donor_end = donor.subtree_end(donor_pos);
+    std::size_t rnum = recipient.node_num();
+    long delta =
+        static_cast<long>(donor_end - donor_pos)
+        - static_cast<long>(end - pos);
+
+    // single allocation for the resulting tree
+    Tree tree;
+    tree.data_ = Tree::allocate(rnum + delta, alloc.arena());
+    Tree::Node* nodes = tree.data_->nodes();
+    nodes = std::copy(recipient.begin(), recipient.begin() + pos, nodes);
+    nodes = std::copy(donor.begin() + donor_pos, donor.begin() + donor_end, nodes);
+    std::copy(recipient.begin() + end, recipient.end(), nodes);
+
+    // only ancestors of the replaced subtree have to be updated
+    tree.update_path(0, pos, delta);
+
+    // merge parent indices
+    const Tree::Data* rd = recipient.data_;
+    const Tree::Data* dd = donor.data_;
+    const std::uint32_t* ri = rd->index();
+    const std::uint32_t* di = dd->index();
+    const std::uint32_t* ri_terms = ri + rd->func_num;
+    const std::uint32_t* di_terms = di + dd->func_num;
+    const std::uint32_t* ri_end = ri + rd->index_num;
+    const std::uint32_t* di_end = di + dd->index_num;
+    long donor_offset =
+        static_cast<long>(pos) - static_cast<long>(donor_pos);
+    std::uint32_t* index = tree.data_->index();
+    std::uint32_t* it = index;
+    it = copy_positions(it, ri, ri_terms, 0, pos, 0);
+    it = copy_positions(it, di, di_terms, donor_pos, donor_end, donor_offset);
+    it = copy_positions(it, ri, ri_terms, end, rnum, delta);
+    tree.data_->func_num = it - index;
+    it = copy_positions(it, ri_terms, ri_end, 0, pos, 0);
+    it = copy_positions(it, di_terms, di_end, donor_pos, donor_end, donor_offset);
+    it = copy_positions(it, ri_terms, ri_end, end, rnum, delta);
+    tree.data_->index_num = it - index;
+    return tree;
+}
+
+static void append_full(
+    Tree::NodeList& nodes,
     const TermList& term_list,
     const FuncList& func_list,
-    unsigned depth)
+    unsigned depth,
+    Rng& rng)
 {
     if (depth == 0) {
-        return Tree(random_element(term_list));
+        nodes.emplace_back(random_element(term_list, rng).get());
 
     } else {
-        Tree t(random_element(func_list));
-        for (unsigned i = 0; i < t.child_num(); ++i)
-            t.set_child(i, full(term_list, func_list, depth - 1));
-        return t;
+        const Func* func = random_element(func_list, rng).get();
+        nodes.emplace_back(func);
+        for (unsigned i = 0; i < func->arity(); ++i)
+            append_full(nodes, term_list, func_list, depth - 1, rng);
     }
 }
 
-Tree grow(
+static void append_grow(
+    Tree::NodeList& nodes,
     const TermList& term_list,
     const FuncList& func_list,
-    unsigned depth)
+    unsigned depth,
+    Rng& rng)
 {
     if (depth == 0) {
-        return Tree(random_element(term_list));
+        nodes.emplace_back(random_element(term_list, rng).get());
 
     } else {
-        std::random_device rd;
         std::uniform_int_distribution<unsigned> distr(
             0, term_list.size() + func_list.size());
-        if (distr(rd) < term_list.size()) {
-            return Tree(random_element(term_list));
+        if (distr(rng) < term_list.size()) {
+            nodes.emplace_back(random_element(term_list, rng).get());
         } else {
-            Tree t(random_element(func_list));
-            for (unsigned i = 0; i < t.child_num(); ++i)
-                t.set_child(i, grow(term_list, func_list, depth - 1));
-            return t;
+            const Func* func = random_element(func_list, rng).get();
+            nodes.emplace_back(func);
+            for (unsigned i = 0; i < func->arity(); ++i)
+                append_grow(nodes, term_list, func_list, depth - 1, rng);
         }
     }
 }
+
+Tree full(
+    const TermList& term_list,
+    const FuncList& func_list,
+    unsigned depth,
+    Rng& rng)
+{
+    Tree::NodeList nodes;
+    append_full(nodes, term_list, func_list, depth, rng);
+    return Tree(nodes);
+}
+
+Tree grow(
+    const TermList& term_list,
+    const FuncList& func_list,
+    unsigned depth,
+    Rng& rng)
+{
+    Tree::NodeList nodes;
+    append_grow(nodes, term_list, func_list, depth, rng);
+    return Tree(nodes);
+}
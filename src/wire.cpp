@@ -0,0 +1,258 @@
+#include "wire.hpp"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+void WireWriter::put_u16(std::uint16_t value) {
+    put_u8(value & 0xff);
+    put_u8(value >> 8);
+}
+
+void WireWriter::put_u32(std::uint32_t value) {
+    put_u16(value & 0xffff);
+    put_u16(value >> 16);
+}
+
+void WireWriter::put_u64(std::uint64_t value) {
+    put_u32(value & 0xffffffff);
+    put_u32(value >> 32);
+}
+
+void WireWriter::put_double(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u64(bits);
+}
+
+void WireWriter::put_varint(std::uint64_t value) {
+    while (value >= 0x80) {
+        put_u8((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    put_u8(value);
+}
+
+void WireWriter::put_string(const std::string& value) {
+    put_u32(value.size());
+    out_ += value;
+}
+
+const unsigned char* WireReader::take(std::size_t size) {
+    if (static_cast<std::size_t>(end_ - pos_) < size)
+        throw std::runtime_error("Unexpected end of data");
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(pos_);
+    pos_ += size;
+    return data;
+}
+
+std::uint8_t WireReader::get_u8() {
+    return *take(1);
+}
+
+std::uint16_t WireReader::get_u16() {
+    const unsigned char* data = take(2);
+    return data[0] | (data[1] << 8);
+}
+
+std::uint32_t WireReader::get_u32() {
+    std::uint32_t low = get_u16();
+    return low | (static_cast<std::uint32_t>(get_u16()) << 16);
+}
+
+std::uint64_t WireReader::get_u64() {
+    std::uint64_t low = get_u32();
+    return low | (static_cast<std::uint64_t>(get_u32()) << 32);
+}
+
+double WireReader::get_double() {
+    std::uint64_t bits = get_u64();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::uint64_t WireReader::get_varint() {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        std::uint8_t byte = get_u8();
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("Invalid varint");
+}
+
+std::string WireReader::get_string() {
+    std::uint32_t size = get_u32();
+    return std::string(reinterpret_cast<const char*>(take(size)), size);
+}
+
+
+// 1 byte codes are used up to this number of codes
+static const std::size_t ShortCodeNum = 256;
+
+TreeCodec::TreeCodec(const TermList& term_list, const FuncList& func_list)
+    : exprs_(1, nullptr),
+      term_num_(term_list.size())
+{
+    for (const auto& term : term_list)
+        add(term.get());
+    for (const auto& func : func_list)
+        add(func.get());
+}
+
+TreeCodec::TreeCodec(
+    WireReader& reader,
+    const TermList& term_list,
+    const FuncList& func_list)
+    : exprs_(1, nullptr)
+{
+    // same names are matched in order
+    std::vector<bool> term_used(term_list.size());
+    term_num_ = reader.get_u32();
+    for (std::size_t i = 0; i < term_num_; ++i) {
+        std::string name = reader.get_string();
+        std::size_t k = 0;
+        while (k < term_list.size()
+               && (term_used[k] || term_list[k]->name() != name))
+        {
+            ++k;
+        }
+        if (k == term_list.size())
+            throw std::runtime_error("Terminal not found: " + name);
+        term_used[k] = true;
+        add(term_list[k].get());
+    }
+    std::vector<bool> func_used(func_list.size());
+    std::uint32_t func_num = reader.get_u32();
+    for (std::uint32_t i = 0; i < func_num; ++i) {
+        std::string name = reader.get_string();
+        unsigned arity = reader.get_u16();
+        std::size_t k = 0;
+        while (k < func_list.size()
+               && (func_used[k]
+                   || func_list[k]->name() != name
+                   || func_list[k]->arity() != arity))
+        {
+            ++k;
+        }
+        if (k == func_list.size())
+            throw std::runtime_error("Function not found: " + name);
+        func_used[k] = true;
+        add(func_list[k].get());
+    }
+}
+
+void TreeCodec::add(const Expr* expr) {
+    if (exprs_.size() > std::numeric_limits<std::uint16_t>::max())
+        throw std::invalid_argument("Too many expressions to encode");
+    codes_[expr] = exprs_.size();
+    exprs_.push_back(expr);
+}
+
+void TreeCodec::write_table(WireWriter& writer) const {
+    writer.put_u32(term_num_);
+    for (std::size_t i = 1; i <= term_num_; ++i)
+        writer.put_string(exprs_[i]->name());
+    writer.put_u32(exprs_.size() - 1 - term_num_);
+    for (std::size_t i = 1 + term_num_; i < exprs_.size(); ++i) {
+        writer.put_string(exprs_[i]->name());
+        writer.put_u16(exprs_[i]->arity());
+    }
+}
+
+void TreeCodec::write(WireWriter& writer, const Tree& tree) const {
+    bool short_codes = exprs_.size() <= ShortCodeNum;
+    writer.put_varint(tree.node_num());
+    for (const Tree::Node& node : tree) {
+        std::uint16_t code = 0;
+        if (node.expr) {
+            auto it = codes_.find(node.expr);
+            if (it == codes_.end())
+                throw std::invalid_argument("Unknown expression in tree");
+            code = it->second;
+        }
+        if (short_codes) {
+            writer.put_u8(code);
+        } else {
+            writer.put_u16(code);
+        }
+    }
+}
+
+Tree TreeCodec::read(WireReader& reader, const Tree::Allocator& alloc) const {
+    bool short_codes = exprs_.size() <= ShortCodeNum;
+    std::uint64_t node_num = reader.get_varint();
+    if (node_num == 0)
+        return Tree();
+    // node number is not trusted, codes must be in the data
+    std::size_t code_size = short_codes ? 1 : 2;
+    if (node_num > std::numeric_limits<std::uint32_t>::max()
+        || node_num > reader.remaining() / code_size)
+    {
+        throw std::runtime_error("Invalid tree data");
+    }
+
+    // check that nodes make a single tree while reading
+    Tree::NodeList nodes;
+    nodes.reserve(node_num);
+    std::size_t open = 1; // number of nodes to read
+    for (std::uint64_t i = 0; i < node_num; ++i) {
+        std::uint16_t code = short_codes ? reader.get_u8() : reader.get_u16();
+        if (open == 0)
+            throw std::runtime_error("Invalid tree data");
+        if (code >= exprs_.size())
+            throw std::runtime_error("Invalid expression code");
+        nodes.emplace_back(exprs_[code]);
+        open += nodes.back().arity;
+        --open;
+    }
+    if (open != 0)
+        throw std::runtime_error("Invalid tree data");
+    return Tree(nodes, alloc);
+}
+
+// flags
+static const std::uint8_t HasFitness = 1;
+static const std::uint8_t FitnessBounded = 2;
+
+void IndivCodec::write(WireWriter& writer, const Indiv& indiv) const {
+    std::uint8_t flags = 0;
+    if (indiv.has_fitness())
+        flags |= HasFitness;
+    if (indiv.has_fitness() && indiv.fitness_bounded())
+        flags |= FitnessBounded;
+    writer.put_u8(flags);
+    if (indiv.has_fitness())
+        writer.put_double(indiv.fitness());
+    tree_codec_.write(writer, indiv.tree());
+}
+
+void IndivCodec::write(WireWriter& writer, const Population& population) const {
+    writer.put_u32(population.size());
+    for (const Indiv& indiv : population)
+        write(writer, indiv);
+}
+
+Indiv IndivCodec::read_indiv(WireReader& reader) const {
+    std::uint8_t flags = reader.get_u8();
+    double fitness = 0.0;
+    if (flags & HasFitness)
+        fitness = reader.get_double();
+
+    Indiv indiv{tree_codec_.read(reader)};
+    // individuals are evaluated, e.g. after migration
+    if (!indiv.tree().valid())
+        throw std::runtime_error("Invalid individual: incomplete tree");
+    if (flags & HasFitness)
+        indiv.set_fitness(fitness, flags & FitnessBounded);
+    return indiv;
+}
+
+Population IndivCodec::read_population(WireReader& reader) const {
+    std::uint32_t size = reader.get_u32();
+    Population population;
+    for (std::uint32_t i = 0; i < size; ++i)
+        population.push_back(read_indiv(reader));
+    return population;
+}
@@ -0,0 +1,230 @@
+// Run checkpoints: resumed run continues exactly as the uninterrupted
+// one, background writes of Checkpointer and their errors
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "checkpoint.hpp"
+#include "func.hpp"
+#include "run.hpp"
+
+namespace {
+
+const std::size_t PopulationSize = 200;
+const unsigned GenerationNum = 30;
+
+int failure_num = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (!ok) {
+        std::cerr << "checkpoint_test.cpp:" << line << ": failed: " << what << std::endl;
+        ++failure_num;
+    }
+}
+
+// fitness cases are generated from the seed as in main.cpp
+void setup(Run& run, std::uint64_t seed) {
+    run.set_generation_number(GenerationNum);
+    run.set_crossover_rate(0.9);
+    run.set_fitness_goal(0.0);
+    run.add_terminal(0, "a");
+    run.add_function(plus2, 2, "+");
+    run.add_function(minus2, 2, "-");
+    run.add_function(mult2, 2, "*");
+    run.add_function(safe_div2, 2, "%");
+    run.add_function(sin1, 1, "sin");
+    run.set_seed(seed);
+    std::uniform_real_distribution<double> param_distr(-2.0, 2.0);
+    for (std::size_t i = 0; i < 100; ++i) {
+        double a = param_distr(run.rng());
+        run.add_fitness_case(Params{a}, a * a * a * a + a * a * a + a * a + a);
+    }
+}
+
+void start(Run& run) {
+    run.set_population(
+        make_pop_ramped_hnh(run.terminals(), run.functions(), 3, PopulationSize, run.rng()));
+}
+
+std::string temp_path(const char* name) {
+    return "/tmp/gptest_" + std::string(name) + "_"
+        + std::to_string(getpid()) + ".ckpt";
+}
+
+bool same_population(Run& a, Run& b) {
+    if (a.population_size() != b.population_size())
+        return false;
+    for (std::size_t i = 0; i < a.population_size(); ++i) {
+        const Indiv& x = a.population()[i];
+        const Indiv& y = b.population()[i];
+        if (x.tree().as_string() != y.tree().as_string()
+            || x.has_fitness() != y.has_fitness()
+            || (x.has_fitness() && !(x.fitness() == y.fitness()
+                || (std::isnan(x.fitness()) && std::isnan(y.fitness())))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// interrupted after `first' generations, resumed in a new run
+void test_resume(const char* name, void (*configure)(Run&)) {
+    const unsigned first = 7;
+    const unsigned more = 8;
+    Run run;
+    setup(run, 1);
+    configure(run);
+    start(run);
+    for (unsigned i = 0; i < first; ++i)
+        run.next_generation();
+    std::string data = run.checkpoint();
+    for (unsigned i = 0; i < more; ++i)
+        run.next_generation();
+
+    Run resumed;
+    setup(resumed, 1);
+    configure(resumed);
+    resumed.restore(data);
+    CHECK(resumed.generation() == first);
+    for (unsigned i = 0; i < more; ++i)
+        resumed.next_generation();
+
+    bool same = resumed.generation() == run.generation()
+        && resumed.rng().state() == run.rng().state()
+        && same_population(resumed, run)
+        && resumed.checkpoint() == run.checkpoint();
+    if (!same)
+        std::cerr << "resumed run differs: " << name << std::endl;
+    CHECK(same);
+}
+
+void plain(Run&) {}
+
+void racing(Run& run) {
+    run.set_racing(true);
+    run.set_fitness_cache(1 << 20);
+}
+
+void dss(Run& run) {
+    run.set_sampling(Run::SampleDss, 20);
+    run.set_simplify(Run::SimplifyTree);
+}
+
+void threads(Run& run) {
+    run.set_thread_num(3);
+    run.set_parsimony(ParsimonyCoefficient, 0.01);
+}
+
+// cases generated from another seed do not match
+void test_mismatch() {
+    Run run;
+    setup(run, 1);
+    start(run);
+    run.next_generation();
+    std::string data = run.checkpoint();
+
+    Run other;
+    setup(other, 2);
+    start(other);
+    bool rejected = false;
+    try {
+        other.restore(data);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    CHECK(rejected);
+    CHECK(other.generation() == 0);
+
+    // truncated and corrupt data
+    for (std::size_t size : {std::size_t(0), std::size_t(7), data.size() / 2, data.size() - 1}) {
+        rejected = false;
+        try {
+            other.restore(data.substr(0, size));
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+    CHECK(other.generation() == 0);
+}
+
+void test_checkpointer() {
+    std::string path = temp_path("checkpoint_test");
+    Run run;
+    setup(run, 3);
+    start(run);
+    {
+        Checkpointer checkpointer(run, path, 3);
+        for (unsigned i = 0; i < 7; ++i) {
+            run.next_generation();
+            checkpointer.update();
+        }
+        checkpointer.wait();
+    }
+    Run resumed;
+    setup(resumed, 3);
+    resumed.load_checkpoint(path);
+    CHECK(resumed.generation() == 6);
+    std::remove(path.c_str());
+
+    // error of background write is thrown by the next call
+    Checkpointer failing(run, "/nonexistent/gptest.ckpt", 1);
+    run.next_generation();
+    failing.update();
+    bool thrown = false;
+    try {
+        failing.wait();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    // error is reported once
+    failing.wait();
+
+    run.next_generation();
+    failing.update();
+    thrown = false;
+    try {
+        failing.save();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    failing.wait();
+
+    bool invalid = false;
+    try {
+        Checkpointer zero(run, path, 0);
+    } catch (const std::invalid_argument&) {
+        invalid = true;
+    }
+    CHECK(invalid);
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_resume("plain", plain);
+        test_resume("racing", racing);
+        test_resume("dss", dss);
+        test_resume("threads", threads);
+        test_mismatch();
+        test_checkpointer();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failure_num > 0) {
+        std::cerr << failure_num << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "checkpoint_test: OK" << std::endl;
+    return 0;
+}
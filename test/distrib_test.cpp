@@ -0,0 +1,275 @@
+// Coordinator and workers on localhost
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "distrib.hpp"
+#include "func.hpp"
+
+namespace {
+
+const unsigned GenerationNum = 40;
+// worker with seed 102 reaches the goal in generation 3,
+// before any migrants are received
+const double FitnessGoal = 40;
+const std::uint64_t Seed = 100;
+const std::size_t WorkerNum = 3;
+const std::size_t PopulationSize = 300;
+
+// message types and header, see distrib.cpp
+const std::uint8_t MsgHello = 1;
+const std::uint8_t MsgStats = 2;
+const std::uint8_t MsgMigrants = 3;
+const std::uint8_t MsgDone = 4;
+const std::size_t HeaderSize = 5;
+
+int failure_num = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (!ok) {
+        std::cerr << "distrib_test.cpp:" << line << ": failed: " << what << std::endl;
+        ++failure_num;
+    }
+}
+
+void setup(Run& run) {
+    run.set_generation_number(GenerationNum);
+    run.set_crossover_rate(0.9);
+    run.set_fitness_goal(FitnessGoal);
+    run.add_terminal(0, "a");
+    run.add_function(plus2, 2, "+");
+    run.add_function(minus2, 2, "-");
+    run.add_function(mult2, 2, "*");
+    run.add_function(sin1, 1, "sin");
+}
+
+Dataset make_dataset() {
+    FitnessCaseList cases;
+    for (int i = 0; i < 50; ++i) {
+        double a = -2 + i * 0.08;
+        cases.emplace_back(
+            Params{a}, a * a * a * a + a * a * a + a * a + a + 0.5 * std::sin(a));
+    }
+    return Dataset(cases);
+}
+
+std::string socket_path(const char* name) {
+    return "/tmp/gptest_" + std::string(name) + "_"
+        + std::to_string(getpid()) + ".sock";
+}
+
+// raw worker connection
+int connect_unix(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un sa = sockaddr_un();
+    sa.sun_family = AF_UNIX;
+    path.copy(sa.sun_path, sizeof(sa.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0)
+        throw std::runtime_error("Cannot connect to " + path);
+    return fd;
+}
+
+void send_message(int fd, std::uint8_t type, const std::string& data) {
+    std::string message;
+    WireWriter writer(message);
+    writer.put_u32(data.size());
+    writer.put_u8(type);
+    message += data;
+    std::size_t pos = 0;
+    while (pos < message.size()) {
+        ssize_t sent = send(fd, message.data() + pos, message.size() - pos, MSG_NOSIGNAL);
+        if (sent <= 0)
+            throw std::runtime_error("Cannot send");
+        pos += sent;
+    }
+}
+
+void skip_bytes(int fd, std::size_t size) {
+    char buffer[65536];
+    while (size > 0) {
+        ssize_t n = recv(fd, buffer, std::min(size, sizeof(buffer)), 0);
+        if (n <= 0)
+            throw std::runtime_error("Cannot receive");
+        size -= n;
+    }
+}
+
+// Workers are separate processes, one of them is killed
+// after a few generations
+void test_workers(const std::string& address) {
+    Dataset dataset = make_dataset();
+    std::string dataset_path = share_dataset(
+        dataset, "gptest_distrib_test_" + std::to_string(getpid()) + ".dat");
+    Run run;
+    setup(run);
+    Coordinator coordinator(address, run.terminals(), run.functions());
+
+    const std::size_t KilledWorker = 1;
+    std::vector<pid_t> pids;
+    for (std::size_t i = 0; i < WorkerNum; ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            Run worker_run;
+            setup(worker_run);
+            worker_run.load_dataset(dataset_path);
+            worker_run.set_seed(Seed + i);
+            worker_run.set_population(make_pop_ramped_hnh(
+                worker_run.terminals(), worker_run.functions(), 3, PopulationSize,
+                worker_run.rng()));
+            Worker worker(coordinator.address(), worker_run);
+            worker.set_migration_interval(5);
+            if (i == KilledWorker) {
+                for (int generation = 0; generation < 5; ++generation)
+                    worker_run.next_generation();
+                raise(SIGKILL);
+            }
+            worker.run();
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    coordinator.run(WorkerNum, 5000);
+    for (std::size_t i = 0; i < pids.size(); ++i) {
+        int status;
+        waitpid(pids[i], &status, 0);
+        if (i == KilledWorker)
+            CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+        else
+            CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    unlink(dataset_path.c_str());
+
+    CHECK(coordinator.lost_worker_num() == 1);
+
+    const auto& stats = coordinator.stats();
+    CHECK(!stats.empty() && stats.size() <= GenerationNum);
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        CHECK(stats[i].generation == i + 1);
+        CHECK(stats[i].worker_num >= 1 && stats[i].worker_num <= WorkerNum - 1);
+        CHECK(stats[i].population_size == stats[i].worker_num * PopulationSize);
+        CHECK(stats[i].best <= stats[i].worst);
+    }
+    CHECK(stats.front().worker_num == WorkerNum - 1);
+
+    // harvest is sent only if solution is found
+    CHECK(coordinator.solution_found());
+    CHECK(!coordinator.harvest().empty());
+    std::set<const Expr*> exprs;
+    for (const auto& term : run.terminals())
+        exprs.insert(term.get());
+    for (const auto& func : run.functions())
+        exprs.insert(func.get());
+    for (const Indiv& indiv : coordinator.harvest()) {
+        CHECK(indiv.has_fitness() && indiv.fitness() <= FitnessGoal);
+        // decoded with coordinator's lists
+        for (const Tree::Node& node : indiv.tree())
+            CHECK(!node.expr || exprs.count(node.expr));
+    }
+}
+
+// Worker is disconnected while migrants are sent to it
+// from another worker in the same poll round
+void test_closed_peer() {
+    Run run;
+    setup(run);
+    std::string path = socket_path("distrib_test");
+    Coordinator coordinator("unix:" + path, run.terminals(), run.functions());
+
+    // accepted in this order
+    int fd_a = connect_unix(path);
+    int fd_b = connect_unix(path);
+    int fd_c = connect_unix(path);
+    for (int fd : {fd_a, fd_b, fd_c})
+        send_message(fd, MsgHello, std::string());
+
+    bool failed = false;
+    std::thread thread([&coordinator, &failed]() {
+        try {
+            coordinator.run(WorkerNum, 5000);
+        } catch (const std::exception&) {
+            failed = true;
+        }
+    });
+    usleep(200000);
+
+    // coordinator blocks passing large migrants from `c' to `a'
+    const std::size_t LargeSize = 8 << 20;
+    send_message(fd_c, MsgMigrants, std::string(LargeSize, '\0'));
+    usleep(200000);
+    // `b' is next to `a'
+    close(fd_b);
+    std::string migrants;
+    WireWriter writer(migrants);
+    IndivCodec codec(run.terminals(), run.functions());
+    codec.write(writer, Population());
+    send_message(fd_a, MsgMigrants, migrants);
+    usleep(100000);
+    skip_bytes(fd_a, HeaderSize + LargeSize);
+
+    std::string done(1, '\0');
+    done += migrants;
+    send_message(fd_a, MsgDone, done);
+    send_message(fd_c, MsgDone, done);
+    close(fd_a);
+    close(fd_c);
+    thread.join();
+
+    CHECK(!failed);
+    CHECK(coordinator.lost_worker_num() == 1);
+    CHECK(coordinator.harvest().empty());
+}
+
+// Worker reporting a generation far ahead is disconnected
+void test_invalid_stats() {
+    Run run;
+    setup(run);
+    std::string path = socket_path("distrib_test");
+    Coordinator coordinator("unix:" + path, run.terminals(), run.functions());
+    int fd = connect_unix(path);
+    send_message(fd, MsgHello, std::string());
+    std::string stats;
+    WireWriter writer(stats);
+    writer.put_u32(4000000000u);
+    writer.put_double(1.0);
+    writer.put_double(2.0);
+    writer.put_double(3.0);
+    writer.put_u32(PopulationSize);
+    send_message(fd, MsgStats, stats);
+    coordinator.run(1, 5000);
+    close(fd);
+
+    CHECK(coordinator.lost_worker_num() == 1);
+    CHECK(coordinator.stats().empty());
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_closed_peer();
+        test_invalid_stats();
+        test_workers("unix:" + socket_path("distrib_test"));
+        test_workers("127.0.0.1:0");
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failure_num > 0) {
+        std::cerr << failure_num << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "distrib_test: OK" << std::endl;
+    return 0;
+}
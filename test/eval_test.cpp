@@ -0,0 +1,220 @@
+// Tree evaluators: BatchEval, Program interpreter and native code
+// must give exactly the same values
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "eval.hpp"
+#include "func.hpp"
+#include "primitives.hpp"
+#include "program.hpp"
+#include "rng.hpp"
+#include "simplify.hpp"
+#include "tree.hpp"
+
+namespace {
+
+const std::size_t TreeNum = 2000;
+const unsigned MaxDepth = 7;
+
+int failure_num = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (!ok) {
+        std::cerr << "eval_test.cpp:" << line << ": failed: " << what << std::endl;
+        ++failure_num;
+    }
+}
+
+// same bits, any NaN is equal to any NaN
+bool same_value(double a, double b) {
+    if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b);
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool same_values(const std::vector<double>& a, const std::vector<double>& b) {
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t k = 0; k < a.size(); ++k)
+        if (!same_value(a[k], b[k]))
+            return false;
+    return true;
+}
+
+// argument order matters
+double sub_scaled2(const Params& args) {
+    return args[0] - 2.0 * args[1];
+}
+
+double weigh3(double a, double b, double c) {
+    return a * 100.0 + b * 10.0 - c;
+}
+
+std::shared_ptr<Func> builtin(
+    double (*f)(const Params&),
+    unsigned arity,
+    const std::string& name)
+{
+    return std::make_shared<Func>(
+        f, arity, name, find_batch_function(f), find_builtin(f));
+}
+
+// built-in, generic (no batch or stack version) and stack functions
+FuncList make_funcs() {
+    FuncList funcs = {
+        builtin(plus2, 2, "+"),
+        builtin(minus2, 2, "-"),
+        builtin(mult2, 2, "*"),
+        builtin(mult3, 3, "*3"),
+        builtin(safe_div2, 2, "%"),
+        builtin(sin1, 1, "sin"),
+        builtin(cos1, 1, "cos"),
+        builtin(rlog1, 1, "rlog"),
+        builtin(exp1, 1, "exp"),
+        std::make_shared<Func>(sub_scaled2, 2, "sub2")};
+    PrimitiveSet<Prim3<weigh3>> prims({"weigh3"});
+    funcs.insert(funcs.end(), prims.funcs().begin(), prims.funcs().end());
+    return funcs;
+}
+
+TermList make_terms() {
+    return {
+        std::make_shared<Term>(0, "a"),
+        std::make_shared<Term>(1, "b"),
+        std::make_shared<Term>(2, "c")};
+}
+
+// zero, negative zero, NaN and infinite values for safe division
+Dataset make_dataset() {
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const double special[] = {0.0, -0.0, nan, inf, -inf, 1.0, -1.0, 1e300};
+    FitnessCaseList cases;
+    for (double a : special)
+        for (double b : special)
+            cases.emplace_back(Params{a, b, 0.0}, 0.0);
+    for (int i = 0; i < 300; ++i) {
+        double a = -3.0 + i * 0.02;
+        cases.emplace_back(Params{a, std::sin(i * 0.7), (i % 7 == 0) ? 0.0 : a * a}, 0.0);
+    }
+    return Dataset(cases);
+}
+
+std::vector<double> eval_batch(const Tree& tree, const Dataset& dataset) {
+    std::vector<double> out(dataset.case_num());
+    BatchEval evaluator;
+    evaluator.eval(tree, dataset, out.data());
+    return out;
+}
+
+std::vector<double> eval_program(const Program& program, const Dataset& dataset) {
+    std::vector<double> out(dataset.case_num());
+    program.eval(dataset, out.data());
+    return out;
+}
+
+// program values by case, scalar interpreter
+std::vector<double> eval_scalar(const Program& program, const Dataset& dataset) {
+    std::vector<double> out(dataset.case_num());
+    Params params;
+    for (std::size_t k = 0; k < dataset.case_num(); ++k) {
+        dataset.params(k, params);
+        out[k] = program.eval(params);
+    }
+    return out;
+}
+
+void test_program(Program& program, const Dataset& dataset, const std::vector<double>& expected) {
+    CHECK(same_values(eval_program(program, dataset), expected));
+    CHECK(same_values(eval_scalar(program, dataset), expected));
+    if (!NativeCode::supported())
+        return;
+    CHECK(program.compile_native());
+    CHECK(program.has_native());
+    CHECK(same_values(eval_program(program, dataset), expected));
+
+    // partial and empty ranges
+    std::size_t begin = 5;
+    std::size_t end = dataset.case_num() - 3;
+    std::vector<double> out(dataset.case_num(), 42.0);
+    program.eval(dataset, begin, end, out.data());
+    bool same = true;
+    for (std::size_t k = 0; k < end - begin; ++k)
+        same = same && same_value(out[k], expected[begin + k]);
+    CHECK(same);
+    CHECK(out[end - begin] == 42.0);
+    std::fill(out.begin(), out.end(), 42.0);
+    program.eval(dataset, begin, begin, out.data());
+    CHECK(out[0] == 42.0);
+}
+
+void test_random_trees() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    Dataset dataset = make_dataset();
+    Rng rng(12345);
+    for (std::size_t i = 0; i < TreeNum; ++i) {
+        unsigned depth = 1 + i % MaxDepth;
+        Tree tree = (i % 2)
+            ? full(terms, funcs, depth, rng)
+            : grow(terms, funcs, depth, rng);
+        std::vector<double> expected = eval_batch(tree, dataset);
+
+        Program program(tree);
+        test_program(program, dataset, expected);
+
+        // constants of simplified tree, simplified values are
+        // compared with the tree in simplify_test
+        Program simplified_program{Simplified(tree)};
+        std::vector<double> simplified = eval_scalar(simplified_program, dataset);
+        test_program(simplified_program, dataset, simplified);
+    }
+}
+
+void test_safe_div() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    const Func* div = funcs[4].get();
+    CHECK(div->name() == "%");
+    Dataset dataset = make_dataset();
+    // (% a b)
+    Tree::NodeList nodes = {
+        Tree::Node(div), Tree::Node(terms[0].get()), Tree::Node(terms[1].get())};
+    Tree tree(nodes);
+    std::vector<double> expected = eval_batch(tree, dataset);
+    Params params;
+    bool same = true;
+    for (std::size_t k = 0; k < dataset.case_num(); ++k) {
+        dataset.params(k, params);
+        same = same && same_value(expected[k], safe_div2({params[0], params[1]}));
+    }
+    CHECK(same);
+    Program program(tree);
+    test_program(program, dataset, expected);
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_safe_div();
+        test_random_trees();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failure_num > 0) {
+        std::cerr << failure_num << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "eval_test: OK" << std::endl;
+    return 0;
+}
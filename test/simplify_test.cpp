@@ -0,0 +1,217 @@
+// Simplified trees must have the values of the original trees
+// where all subtree values are finite (see simplify.hpp)
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "eval.hpp"
+#include "func.hpp"
+#include "program.hpp"
+#include "rng.hpp"
+#include "sexpr.hpp"
+#include "simplify.hpp"
+#include "tree.hpp"
+
+namespace {
+
+const std::size_t TreeNum = 3000;
+const unsigned MaxDepth = 6;
+
+int failure_num = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (!ok) {
+        std::cerr << "simplify_test.cpp:" << line << ": failed: " << what << std::endl;
+        ++failure_num;
+    }
+}
+
+double zero0(const Params&) {
+    return 0.0;
+}
+
+double one0(const Params&) {
+    return 1.0;
+}
+
+double two0(const Params&) {
+    return 2.0;
+}
+
+std::shared_ptr<Func> make_func(
+    double (*f)(const Params&),
+    unsigned arity,
+    const std::string& name)
+{
+    return std::make_shared<Func>(
+        f, arity, name, find_batch_function(f), find_builtin(f));
+}
+
+TermList make_terms() {
+    return {
+        std::make_shared<Term>(0, "a"),
+        std::make_shared<Term>(1, "b")};
+}
+
+// constants are functions without arguments
+FuncList make_funcs() {
+    return {
+        make_func(plus2, 2, "+"),
+        make_func(minus2, 2, "-"),
+        make_func(mult2, 2, "*"),
+        make_func(mult3, 3, "*3"),
+        make_func(safe_div2, 2, "%"),
+        make_func(sin1, 1, "sin"),
+        make_func(rlog1, 1, "rlog"),
+        make_func(exp1, 1, "exp"),
+        make_func(zero0, 0, "zero"),
+        make_func(one0, 0, "one"),
+        make_func(two0, 0, "two")};
+}
+
+// values up to 1e200 make exp and products overflow
+Dataset make_dataset() {
+    FitnessCaseList cases;
+    for (int i = 0; i < 100; ++i) {
+        double a = -3.0 + i * 0.06;
+        double b = (i % 10 == 0) ? 0.0 : (i % 10 == 1) ? 1.0 : std::cos(i);
+        cases.emplace_back(Params{a, b}, 0.0);
+    }
+    cases.emplace_back(Params{800.0, 1e200}, 0.0);
+    cases.emplace_back(Params{-800.0, -1e200}, 0.0);
+    return Dataset(cases);
+}
+
+std::vector<double> eval_tree(const Tree& tree, const Dataset& dataset) {
+    std::vector<double> out(dataset.case_num());
+    BatchEval evaluator;
+    evaluator.eval(tree, dataset, out.data());
+    return out;
+}
+
+std::vector<double> eval_simplified(const Simplified& simplified, const Dataset& dataset) {
+    std::vector<double> out(dataset.case_num());
+    Program(simplified).eval(dataset, out.data());
+    return out;
+}
+
+// true for cases where all subtrees of `tree' are finite
+std::vector<bool> finite_cases(const Tree& tree, const Dataset& dataset) {
+    std::vector<bool> finite(dataset.case_num(), true);
+    for (std::size_t pos = 0; pos < tree.node_num(); ++pos) {
+        Tree::NodeList nodes(tree.begin() + pos, tree.begin() + tree.subtree_end(pos));
+        std::vector<double> values = eval_tree(Tree(nodes), dataset);
+        for (std::size_t k = 0; k < values.size(); ++k)
+            if (!std::isfinite(values[k]))
+                finite[k] = false;
+    }
+    return finite;
+}
+
+void test_random_trees() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    Dataset dataset = make_dataset();
+    Rng rng(2024);
+    std::size_t simplified_num = 0;
+    std::size_t finite_num = 0;
+    std::size_t nonfinite_num = 0;
+    for (std::size_t i = 0; i < TreeNum; ++i) {
+        Tree tree = grow(terms, funcs, 1 + i % MaxDepth, rng);
+        Simplified simplified(tree);
+        CHECK(simplified.size() <= tree.node_num());
+        if (simplified.size() < tree.node_num())
+            ++simplified_num;
+
+        std::vector<double> expected = eval_tree(tree, dataset);
+        std::vector<double> values = eval_simplified(simplified, dataset);
+        // constants are replaced with their source subtrees
+        std::vector<double> tree_values = eval_tree(simplified.tree(), dataset);
+        std::vector<bool> finite = finite_cases(tree, dataset);
+        for (std::size_t k = 0; k < dataset.case_num(); ++k) {
+            if (finite[k]) {
+                ++finite_num;
+                // -0 and 0 are equal
+                CHECK(values[k] == expected[k]);
+                CHECK(tree_values[k] == expected[k]);
+            } else {
+                ++nonfinite_num;
+            }
+        }
+    }
+    // rules and overflow are exercised
+    CHECK(simplified_num > TreeNum / 10);
+    CHECK(nonfinite_num > 0);
+    CHECK(finite_num > nonfinite_num);
+}
+
+// documented differences where a removed subtree is not finite
+void test_nonfinite() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    TreeParser parser(terms, funcs);
+    FitnessCaseList cases = {
+        {Params{1000.0, 0.0}, 0.0},
+        {Params{std::nan(""), 0.0}, 0.0},
+        {Params{2.0, 0.0}, 0.0}};
+    Dataset dataset(cases);
+    struct Case {
+        const char* tree;
+        const char* simplified;
+        double original[3]; // by fitness case, NaN for NaN
+    };
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const Case checks[] = {
+        // x - x -> 0
+        {"(- (exp a) (exp a))", "0", {nan, nan, 0.0}},
+        // x * 0 -> 0
+        {"(* (exp a) (zero))", "0", {nan, nan, 0.0}},
+        // 0 / x -> 0
+        {"(% (zero) a)", "0", {0.0, nan, 0.0}},
+        // x * (x / x) -> x
+        {"(* (exp a) (% (exp a) (exp a)))", "(exp a)", {nan, nan, std::exp(2.0)}},
+        // folded constant is exact
+        {"(exp (* (two) (two)))", "54.5982", {std::exp(4.0), std::exp(4.0), std::exp(4.0)}}};
+    for (const Case& c : checks) {
+        Tree tree = parser.parse(c.tree);
+        Simplified simplified(tree);
+        CHECK(simplified.as_string() == c.simplified);
+        std::vector<double> original = eval_tree(tree, dataset);
+        std::vector<double> values = eval_simplified(simplified, dataset);
+        for (std::size_t k = 0; k < dataset.case_num(); ++k) {
+            CHECK(std::isnan(c.original[k])
+                ? std::isnan(original[k])
+                : original[k] == c.original[k]);
+            // finite results are the same
+            if (std::isfinite(original[k]))
+                CHECK(values[k] == original[k]);
+        }
+    }
+    // results differ where the removed subtree is infinite or NaN
+    Tree tree = parser.parse("(- (exp a) (exp a))");
+    CHECK(eval_simplified(Simplified(tree), dataset)[0] == 0.0);
+    CHECK(std::isnan(eval_tree(tree, dataset)[0]));
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_random_trees();
+        test_nonfinite();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failure_num > 0) {
+        std::cerr << failure_num << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "simplify_test: OK" << std::endl;
+    return 0;
+}
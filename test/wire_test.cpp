@@ -0,0 +1,230 @@
+// Tree text and binary forms: Tree::write, TreeParser, TreeCodec
+// and IndivCodec round trips, malformed input
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "func.hpp"
+#include "indiv.hpp"
+#include "rng.hpp"
+#include "sexpr.hpp"
+#include "tree.hpp"
+#include "wire.hpp"
+
+namespace {
+
+const std::size_t TreeNum = 1000;
+const unsigned MaxDepth = 6;
+
+int failure_num = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, const char* what, int line) {
+    if (!ok) {
+        std::cerr << "wire_test.cpp:" << line << ": failed: " << what << std::endl;
+        ++failure_num;
+    }
+}
+
+TermList make_terms() {
+    return {
+        std::make_shared<Term>(0, "a"),
+        std::make_shared<Term>(1, "b")};
+}
+
+FuncList make_funcs() {
+    return {
+        std::make_shared<Func>(plus2, 2, "+"),
+        std::make_shared<Func>(minus2, 2, "-"),
+        std::make_shared<Func>(mult3, 3, "*3"),
+        std::make_shared<Func>(sin1, 1, "sin")};
+}
+
+bool same_nodes(const Tree& a, const Tree& b) {
+    if (a.node_num() != b.node_num())
+        return false;
+    for (std::size_t pos = 0; pos < a.node_num(); ++pos)
+        if (a.node(pos).expr != b.node(pos).expr)
+            return false;
+    return true;
+}
+
+// true if `f' throws std::runtime_error
+template <typename F>
+bool fails(F f) {
+    try {
+        f();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void test_text() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    TreeParser parser(terms, funcs);
+    Rng rng(7);
+    for (std::size_t i = 0; i < TreeNum; ++i) {
+        Tree tree = grow(terms, funcs, 1 + i % MaxDepth, rng);
+        std::string s = tree.as_string();
+
+        std::ostringstream out;
+        tree.write(out);
+        CHECK(out.str() == s);
+
+        // truncated output, full length is returned
+        std::vector<char> buffer(s.size() / 2 + 1);
+        CHECK(tree.write(buffer.data(), buffer.size()) == s.size());
+        CHECK(std::string(buffer.data(), buffer.size()) == s.substr(0, buffer.size()));
+
+        Tree parsed = parser.parse("  " + s + "\n");
+        CHECK(same_nodes(parsed, tree));
+    }
+
+    // several trees in one buffer
+    std::string two = "(+ a b)(sin a)";
+    const char* pos = two.data();
+    Tree first = parser.parse(pos, two.data() + two.size());
+    Tree second = parser.parse(pos, two.data() + two.size());
+    CHECK(first.as_string() == "(+ a b)");
+    CHECK(second.as_string() == "(sin a)");
+    CHECK(pos == two.data() + two.size());
+
+    // missing node is parsed, tree is not valid
+    Tree incomplete = parser.parse("(+ a [empty])");
+    CHECK(!incomplete.valid());
+    CHECK(incomplete.as_string() == "(+ a [empty])");
+    CHECK(parser.parse("[empty]").empty());
+
+    CHECK(fails([&] { parser.parse(""); }));
+    CHECK(fails([&] { parser.parse("(+ a"); }));
+    CHECK(fails([&] { parser.parse("(+ a)"); }));
+    CHECK(fails([&] { parser.parse("(sin a b)"); }));
+    CHECK(fails([&] { parser.parse("(*3 a b)"); }));
+    CHECK(fails([&] { parser.parse("(+ a b))"); }));
+    CHECK(fails([&] { parser.parse("a b"); }));
+    CHECK(fails([&] { parser.parse("()"); }));
+    CHECK(fails([&] { parser.parse("(x a)"); }));
+    CHECK(fails([&] { parser.parse("(+ a c)"); }));
+    CHECK(fails([&] { parser.parse("(a)"); }));
+}
+
+void test_binary() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    TreeCodec codec(terms, funcs);
+    IndivCodec indiv_codec(codec);
+    Rng rng(11);
+
+    std::string data;
+    WireWriter writer(data);
+    std::vector<Tree> trees;
+    for (std::size_t i = 0; i < TreeNum; ++i) {
+        trees.push_back(full(terms, funcs, 1 + i % MaxDepth, rng));
+        codec.write(writer, trees.back());
+    }
+    WireReader reader(data);
+    for (const Tree& tree : trees)
+        CHECK(same_nodes(codec.read(reader), tree));
+    CHECK(reader.at_end());
+
+    // code table, lists in other order
+    TermList other_terms = {terms[1], terms[0]};
+    FuncList other_funcs = {funcs[3], funcs[2], funcs[1], funcs[0]};
+    data.clear();
+    codec.write_table(writer);
+    for (const Tree& tree : trees)
+        codec.write(writer, tree);
+    WireReader table_reader(data);
+    TreeCodec other_codec(table_reader, other_terms, other_funcs);
+    for (const Tree& tree : trees)
+        CHECK(same_nodes(other_codec.read(table_reader), tree));
+    CHECK(table_reader.at_end());
+
+    // fitness flags
+    Population population;
+    population.emplace_back(trees[0]);
+    population.emplace_back(trees[1]);
+    population.back().set_fitness(1.5);
+    population.emplace_back(trees[2]);
+    population.back().set_fitness(2.5, true);
+    data.clear();
+    indiv_codec.write(writer, population);
+    WireReader indiv_reader(data);
+    Population read = indiv_codec.read_population(indiv_reader);
+    CHECK(read.size() == 3);
+    CHECK(!read[0].has_fitness());
+    CHECK(read[1].has_fitness() && read[1].fitness() == 1.5 && !read[1].fitness_bounded());
+    CHECK(read[2].has_fitness() && read[2].fitness() == 2.5 && read[2].fitness_bounded());
+    for (std::size_t i = 0; i < read.size(); ++i)
+        CHECK(same_nodes(read[i].tree(), trees[i]));
+}
+
+Tree read_tree(const TreeCodec& codec, const std::string& data) {
+    WireReader reader(data);
+    return codec.read(reader);
+}
+
+Indiv read_indiv(const IndivCodec& codec, const std::string& data) {
+    WireReader reader(data);
+    return codec.read_indiv(reader);
+}
+
+void test_malformed() {
+    TermList terms = make_terms();
+    FuncList funcs = make_funcs();
+    TreeCodec codec(terms, funcs);
+    IndivCodec indiv_codec(codec);
+    // codes: 0 missing, 1-2 terminals, 3 +, 4 -, 5 *3, 6 sin
+
+    // truncated varint, huge node number, truncated codes
+    CHECK(fails([&] { read_tree(codec, std::string("\x80", 1)); }));
+    CHECK(fails([&] { read_tree(codec, std::string("\xff\xff\xff\xff\x0f", 5)); }));
+    CHECK(fails([&] { read_tree(codec, std::string("\x03\x03\x01", 3)); }));
+    // unknown code, wrong arity, nodes after complete tree
+    CHECK(fails([&] { read_tree(codec, std::string("\x01\x07", 2)); }));
+    CHECK(fails([&] { read_tree(codec, std::string("\x02\x03\x01", 3)); }));
+    CHECK(fails([&] { read_tree(codec, std::string("\x02\x01\x01", 3)); }));
+    // missing node is read, individual is rejected
+    std::string missing("\x03\x03\x01\x00", 4);
+    CHECK(!read_tree(codec, missing).valid());
+    CHECK(fails([&] { read_indiv(indiv_codec, std::string(1, '\0') + missing); }));
+    // empty tree
+    CHECK(read_tree(codec, std::string(1, '\0')).empty());
+    CHECK(fails([&] { read_indiv(indiv_codec, std::string(2, '\0')); }));
+
+    // writing a tree with unknown expression
+    Tree foreign{std::make_shared<Term>(0, "a")};
+    std::string data;
+    WireWriter writer(data);
+    bool invalid = false;
+    try {
+        codec.write(writer, foreign);
+    } catch (const std::invalid_argument&) {
+        invalid = true;
+    }
+    CHECK(invalid);
+}
+
+} // namespace
+
+int main() {
+    try {
+        test_text();
+        test_binary();
+        test_malformed();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (failure_num > 0) {
+        std::cerr << failure_num << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "wire_test: OK" << std::endl;
+    return 0;
+}